@@ -11,19 +11,83 @@
 
 #define AI_DELAY 250
 
+#define ENDGAME_CACHE_FILE "endgame.cache"
+#define PROBCUT_FILE "probcut.txt"
+#define TRACE_FILE "trace.json"
+#define GAMES_FILE "games.db"
+#define GAMES_INDEX_FILE "games.idx"
+
+// Move hints are refined up to this depth.
+#define HINT_MAX_DEPTH 6
+
+// The dimensions used when drawing move hints.
+#define HINT_MIN_ALPHA 48
+#define HINT_BAR_HEIGHT 4
+
+struct _Hints {
+	// The board and turn that the hints are for.
+	char board[BOARD_SIZE][BOARD_SIZE];
+	int turn;
+
+	// The valid moves, each with its score from the deepest search so far.
+	Move *moves;
+
+	// The depth that each tile's move has been searched to.
+	int depth[BOARD_SIZE][BOARD_SIZE];
+
+	// The tile under the mouse, whose move is searched first.
+	int hoverX;
+	int hoverY;
+
+	// Incremented whenever the hints are started over, so that the results of any
+	// search of the previous state of the game are thrown away.
+	int generation;
+
+	// Indicate if the hints should be refined, and if the hint thread should stop.
+	bool active;
+	bool quit;
+
+	// The thread which refines the hints in the background, the mutex which must be
+	// held when accessing any of the above, and the condition that the thread waits on
+	// when it has nothing to search.
+	SDL_Thread *thread;
+	SDL_mutex *mutex;
+	SDL_cond *cond;
+
+	// Set when the hint thread's current search is no longer needed. It can be read
+	// without holding the mutex, so that the search can check it while it runs.
+	SDL_atomic_t cancel;
+};
+
+// Stores the analysis of each valid move, which is shown to help the player.
+typedef struct _Hints Hints;
+
+#define HINTS_EMPTY { { { 0 } }, PIECE_EMPTY, NULL, { { 0 } }, 0, 0, 0, false, false, NULL, NULL, \
+	NULL, { 0 } }
+
 // Function prototypes.
 bool init();
 bool load();
 void loop();
-void draw(State state);
+void draw(State state, Hints *hints);
 void close();
 
-void updateInput(SDL_Event e, State *state, int *aiPiece, int *aiDifficulty);
+void updateInput(SDL_Event e, State *state, int *aiPiece, int *aiDifficulty, bool *showHints);
 void drawBoard(SDL_Surface *surface, State state);
+void drawHints(SDL_Surface *surface, Hints *hints);
+
+bool hintsStart(Hints *hints);
+void hintsStop(Hints *hints);
+void hintsUpdate(Hints *hints, State state, bool active);
+void hintsReset(Hints *hints, State state);
+Move *hintsGetNextMove(Hints *hints);
+bool hintsCancelled(void *data);
+int hintsThread(void *data);
 
 void gameReset(State *state);
 void gameDoCurrentTurn(State *state, int x, int y, bool force);
 void gameNextTurn(State *state);
+void gameRecordMove(State *state, int x, int y);
 
 bool playerCanMove(char board[BOARD_SIZE][BOARD_SIZE], int piece);
 bool doAITurn(State *state, int aiDifficulty, int aiPiece, int aiTicks);
@@ -34,6 +98,8 @@ SDL_Surface *loadTexture(char *filename);
 
 void aiTester(State *state, int *pass, int *whiteWins, int *blackWins, int *draws,
 			  int whiteDiff, int blackDiff);
+void aiCalibrator(State *state, int *pass, int *whiteWins, int *blackWins, int *draws,
+				  int whiteDiff, int blackDiff, int games);
 
 // The main rendering window.
 SDL_Window *mainWindow = NULL;
@@ -96,6 +162,21 @@ bool load() {
 	pieceWhiteHover = loadTexture("textures/pieceWhiteHover.bmp");
 	pieceBlackHover = loadTexture("textures/pieceBlackHover.bmp");
 
+	// Allow the hover pieces to be faded when drawing move hints.
+	SDL_SetSurfaceBlendMode(pieceWhiteHover, SDL_BLENDMODE_BLEND);
+	SDL_SetSurfaceBlendMode(pieceBlackHover, SDL_BLENDMODE_BLEND);
+
+	// Load any endgame positions solved by the AI in previous games.
+	if (aiCacheInit(ENDGAME_CACHE_SIZE, ENDGAME_EMPTIES)) {
+		aiCacheLoad(ENDGAME_CACHE_FILE);
+	}
+
+	// Load the ProbCut parameters fitted by aiCalibrator.
+	aiProbCutLoad(PROBCUT_FILE);
+
+	// Open the database that every finished game is added to.
+	databaseOpen(GAMES_FILE, GAMES_INDEX_FILE);
+
 	return tile != NULL && pieceWhite != NULL && pieceBlack != NULL &&
 		pieceWhiteHover != NULL && pieceBlackHover != NULL;
 }
@@ -111,8 +192,14 @@ void loop() {
 	int aiPiece = PIECE_EMPTY; // The AI's piece color.
 	int aiTicks = 0; // Used to delay the AI's move.
 
-	// Seed the random number generator with the current time.
-	srand(time(NULL));
+	// The analysis of the player's moves, and whether or not it should be shown.
+	Hints hints = HINTS_EMPTY;
+	bool showHints = false;
+	bool hintsStarted = hintsStart(&hints);
+
+	// Seed the AI's random number generator with the current time. The games don't
+	// need to be reproducible, so the AI can use the endgame cache.
+	aiSetSeed((unsigned int)time(NULL), false);
 
 	// An event handler.
 	SDL_Event e;
@@ -122,34 +209,59 @@ void loop() {
 
 	// Enter the main game loop.
 	while (!quit) {
+		traceBegin("frame");
+
 		// Handles events on the queue.
+		traceBegin("updateInput");
 		while (SDL_PollEvent(&e) != 0) {
 			// Checks if the user requests to exit.
 			if (e.type == SDL_QUIT) {
 				quit = true;
 			} else {
-				updateInput(e, &state, &aiPiece, &aiDifficulty);
+				updateInput(e, &state, &aiPiece, &aiDifficulty, &showHints);
 			}
 		}
+		traceEnd("updateInput");
 
 		// Do a turn for the AI.
+		traceBegin("doAITurn");
 		if (!doAITurn(&state, aiDifficulty, aiPiece, aiTicks)) {
 			aiTicks = SDL_GetTicks();
 		}
+		traceEnd("doAITurn");
+
+		// Refine the move hints in the background while it's the player's turn.
+		bool hintsVisible = hintsStarted && showHints && state.turn != aiPiece;
+		if (hintsStarted) {
+			hintsUpdate(&hints, state, hintsVisible);
+		}
 
 		// Draw the game.
-		draw(state);
+		traceBegin("draw");
+		draw(state, hintsVisible ? &hints : NULL);
+		traceEnd("draw");
+
+		traceEnd("frame");
+	}
+
+	if (hintsStarted) {
+		hintsStop(&hints);
 	}
 }
 
-// Main drawing function.
-void draw(State state) {
+// Main drawing function. The move hints are only drawn if they aren't NULL.
+void draw(State state, Hints *hints) {
 	// Fill the surface white.
 	SDL_FillRect(mainSurface, NULL, SDL_MapRGB(mainSurface->format, 0xFF, 0xFF, 0xFF));
 
 	// Draws the game board.
 	drawBoard(mainSurface, state);
 
+	// Draws the move hints over the board.
+	if (hints != NULL) {
+		drawHints(mainSurface, hints);
+	}
+
 	// Update the surface.
 	SDL_UpdateWindowSurface(mainWindow);
 }
@@ -167,6 +279,14 @@ void close() {
 	SDL_FreeSurface(pieceWhiteHover);
 	SDL_FreeSurface(pieceBlackHover);
 
+	// Save the endgame positions solved by the AI for the next time the game is run.
+	aiCacheSave(ENDGAME_CACHE_FILE);
+	aiCacheFree();
+
+	// Save the index of the games database so that it doesn't need to be rebuilt.
+	databaseSave(GAMES_INDEX_FILE);
+	databaseClose();
+
 	// Quit SDL.
 	SDL_Quit();
 }
@@ -174,7 +294,7 @@ void close() {
 // MAIN HELPER FUNCTIONS
 
 // Updates keyboard and mouse input.
-void updateInput(SDL_Event e, State *state, int *aiPiece, int *aiDifficulty) {
+void updateInput(SDL_Event e, State *state, int *aiPiece, int *aiDifficulty, bool *showHints) {
 	if (e.type == SDL_MOUSEBUTTONDOWN && state->turn != *aiPiece) {
 		switch (e.button.button) {
 			case SDL_BUTTON_LEFT:
@@ -212,6 +332,25 @@ void updateInput(SDL_Event e, State *state, int *aiPiece, int *aiDifficulty) {
 				*aiDifficulty = AI_EXPERT;
 				*aiPiece = PIECE_BLACK;
 				break;
+			case SDLK_F6:
+				*showHints = !*showHints;
+				break;
+			case SDLK_1: case SDLK_2: case SDLK_3: case SDLK_4: case SDLK_5:
+			case SDLK_6: case SDLK_7: case SDLK_8: case SDLK_9: case SDLK_0:
+				// The number keys choose any difficulty level, with 0 being the highest.
+				gameReset(state);
+				*aiDifficulty = e.key.keysym.sym == SDLK_0 ? AI_LEVELS : e.key.keysym.sym - SDLK_0;
+				*aiPiece = PIECE_BLACK;
+				break;
+			case SDLK_F12:
+				// Start recording a trace, or stop recording and save it.
+				if (traceIsEnabled()) {
+					traceSetEnabled(false);
+					traceSave(TRACE_FILE);
+				} else {
+					traceSetEnabled(true);
+				}
+				break;
 		}
 	}
 }
@@ -240,12 +379,232 @@ void drawBoard(SDL_Surface *surface, State state) {
 	}
 }
 
+// Draws the analysis of each valid move. Better moves are drawn more solidly, with a
+// bar along the bottom of the tile showing the score (green if the player is ahead
+// or red if behind) and a dot along the top for each depth that has been searched.
+// The scores are only estimates until the endgame is solved, so the bars are sized
+// relative to the largest score rather than as a number of pieces.
+void drawHints(SDL_Surface *surface, Hints *hints) {
+	SDL_LockMutex(hints->mutex);
+
+	// Find the range of scores of the moves which have been searched.
+	int best = -SCORE_MAX;
+	int worst = SCORE_MAX;
+	int largest = 0;
+	for (Move *move = hints->moves; move != NULL; move = move->next) {
+		if (hints->depth[move->x][move->y] > 0) {
+			int size = move->score < 0 ? -move->score : move->score;
+			best = move->score > best ? move->score : best;
+			worst = move->score < worst ? move->score : worst;
+			largest = size > largest ? size : largest;
+		}
+	}
+
+	int mx, my;
+	SDL_GetMouseState(&mx, &my);
+
+	SDL_Surface *hintSurface = hints->turn == PIECE_WHITE ? pieceWhiteHover : pieceBlackHover;
+	for (Move *move = hints->moves; move != NULL; move = move->next) {
+		int depth = hints->depth[move->x][move->y];
+		if (depth == 0) {
+			continue;
+		}
+
+		// The tile under the mouse already shows the hover piece.
+		if (move->x != mx / TILE_SIZE || move->y != my / TILE_SIZE) {
+			int alpha = 255;
+			if (best > worst) {
+				alpha = HINT_MIN_ALPHA + (255 - HINT_MIN_ALPHA) * (move->score - worst) / (best - worst);
+			}
+
+			SDL_SetSurfaceAlphaMod(hintSurface, alpha);
+			SDL_BlitSurface(hintSurface, NULL, surface, &getTileRect(move->x, move->y));
+			SDL_SetSurfaceAlphaMod(hintSurface, 255);
+		}
+
+		int left = move->x * TILE_SIZE;
+		int top = move->y * TILE_SIZE;
+		int width = largest > 0 ?
+			(move->score < 0 ? -move->score : move->score) * TILE_SIZE / largest : 0;
+		Uint32 color = move->score >= 0 ? SDL_MapRGB(surface->format, 0x00, 0xC0, 0x00) :
+			SDL_MapRGB(surface->format, 0xC0, 0x00, 0x00);
+		SDL_FillRect(surface, &getRect(left, top + TILE_SIZE - HINT_BAR_HEIGHT, width, HINT_BAR_HEIGHT),
+					 color);
+
+		for (int i = 0; i < depth; i++) {
+			SDL_FillRect(surface, &getRect(left + i * HINT_BAR_HEIGHT * 2, top, HINT_BAR_HEIGHT,
+										   HINT_BAR_HEIGHT), SDL_MapRGB(surface->format, 0x80, 0x80, 0x80));
+		}
+	}
+
+	SDL_UnlockMutex(hints->mutex);
+}
+
+// HINT FUNCTIONS
+
+// Starts the thread which refines the move hints and returns a value indicating if it
+// was successful.
+bool hintsStart(Hints *hints) {
+	hints->mutex = SDL_CreateMutex();
+	if (hints->mutex == NULL) {
+		fprintf(stderr, "Unable to create the hint mutex! SDL_Error: %s\n", SDL_GetError());
+		return false;
+	}
+
+	hints->cond = SDL_CreateCond();
+	if (hints->cond == NULL) {
+		fprintf(stderr, "Unable to create the hint condition! SDL_Error: %s\n", SDL_GetError());
+		SDL_DestroyMutex(hints->mutex);
+		return false;
+	}
+
+	hints->thread = SDL_CreateThread(hintsThread, "hints", hints);
+	if (hints->thread == NULL) {
+		fprintf(stderr, "Unable to create the hint thread! SDL_Error: %s\n", SDL_GetError());
+		SDL_DestroyCond(hints->cond);
+		SDL_DestroyMutex(hints->mutex);
+		return false;
+	}
+
+	return true;
+}
+
+// Stops the thread which refines the move hints and frees the hints from memory. Any
+// search in progress is cancelled rather than waited for.
+void hintsStop(Hints *hints) {
+	SDL_LockMutex(hints->mutex);
+	hints->quit = true;
+	SDL_AtomicSet(&hints->cancel, 1);
+	SDL_CondSignal(hints->cond);
+	SDL_UnlockMutex(hints->mutex);
+
+	SDL_WaitThread(hints->thread, NULL);
+	SDL_DestroyCond(hints->cond);
+	SDL_DestroyMutex(hints->mutex);
+	freeMoveList(hints->moves);
+	hints->moves = NULL;
+}
+
+// Tells the hint thread whether or not to refine the hints for the current state of
+// the game. The hints are only started over once the state of the game changes, so
+// the moves already searched are kept as the mouse moves around. The thread's search
+// is cancelled as soon as the hints are no longer needed.
+void hintsUpdate(Hints *hints, State state, bool active) {
+	int mx, my;
+	SDL_GetMouseState(&mx, &my);
+
+	SDL_LockMutex(hints->mutex);
+	bool wake = active && !hints->active;
+	if (!active && hints->active) {
+		SDL_AtomicSet(&hints->cancel, 1);
+	}
+
+	hints->active = active;
+	if (active && (hints->turn != state.turn || !boardEquals(hints->board, state.board))) {
+		hintsReset(hints, state);
+		wake = true;
+	}
+
+	if (wake) {
+		SDL_CondSignal(hints->cond);
+	}
+
+	hints->hoverX = mx / TILE_SIZE;
+	hints->hoverY = my / TILE_SIZE;
+	SDL_UnlockMutex(hints->mutex);
+}
+
+// Starts the move hints over for the current state of the game, cancelling the search
+// of the previous state.
+void hintsReset(Hints *hints, State state) {
+	SDL_AtomicSet(&hints->cancel, 1);
+	freeMoveList(hints->moves);
+
+	boardCopy(hints->board, state.board);
+	hints->turn = state.turn;
+	hints->moves = getValidMoves(hints->board, hints->turn);
+	hints->generation++;
+	for (int x = 0; x < BOARD_SIZE; x++) {
+		for (int y = 0; y < BOARD_SIZE; y++) {
+			hints->depth[x][y] = 0;
+		}
+	}
+}
+
+// Gets the next move to search one level deeper, or NULL if every move has been
+// searched to the maximum depth. The move under the mouse is searched first so that
+// it stays at least as deep as every other move.
+Move *hintsGetNextMove(Hints *hints) {
+	Move *next = NULL;
+	for (Move *move = hints->moves; move != NULL; move = move->next) {
+		int depth = hints->depth[move->x][move->y];
+		if (depth >= HINT_MAX_DEPTH) {
+			continue;
+		}
+
+		if (next == NULL || depth < hints->depth[next->x][next->y] ||
+			(depth == hints->depth[next->x][next->y] &&
+			 move->x == hints->hoverX && move->y == hints->hoverY)) {
+			next = move;
+		}
+	}
+
+	return next;
+}
+
+// Checks if the hint thread's current search has been cancelled.
+bool hintsCancelled(void *data) {
+	Hints *hints = (Hints*)data;
+	return SDL_AtomicGet(&hints->cancel) != 0;
+}
+
+// The hint thread, which searches the valid moves one at a time, a little deeper each
+// time, so that the hints improve for as long as the player takes to move.
+int hintsThread(void *data) {
+	Hints *hints = (Hints*)data;
+
+	SDL_LockMutex(hints->mutex);
+	while (!hints->quit) {
+		Move *move = hints->active ? hintsGetNextMove(hints) : NULL;
+		if (move == NULL) {
+			// Wait for the game to change.
+			SDL_CondWait(hints->cond, hints->mutex);
+			continue;
+		}
+
+		// Copy the move so that it can be searched without holding the mutex.
+		char board[BOARD_SIZE][BOARD_SIZE];
+		boardCopy(board, hints->board);
+		int turn = hints->turn;
+		int x = move->x;
+		int y = move->y;
+		int depth = hints->depth[x][y] + 1;
+		int generation = hints->generation;
+		SDL_AtomicSet(&hints->cancel, 0);
+		SDL_UnlockMutex(hints->mutex);
+
+		int score;
+		bool finished = aiAnalyseMove(board, turn, x, y, depth, hintsCancelled, hints, &score);
+
+		// The move is only kept if the hints haven't been started over in the meantime.
+		SDL_LockMutex(hints->mutex);
+		if (finished && hints->generation == generation) {
+			move->score = score;
+			hints->depth[x][y] = depth;
+		}
+	}
+
+	SDL_UnlockMutex(hints->mutex);
+	return 0;
+}
+
 // GAME FUNCTIONS
 
 // Resets the game.
 void gameReset(State *state) {
 	boardReset(state->board);
 	state->turn = PIECE_WHITE;
+	state->game.moveCount = 0;
 }
 
 // Makes a move for the current player. A parameter can be inputted to indicate if
@@ -260,6 +619,7 @@ void gameDoCurrentTurn(State *state, int x, int y, bool force) {
 	} else {
 		int points = boardPlace(state->board, x, y, state->turn);
 		if (points > 0) {
+			gameRecordMove(state, x, y);
 			gameNextTurn(state);
 		} else if (force) {
 			for (int x = 0; x < BOARD_SIZE; x++) {
@@ -267,6 +627,8 @@ void gameDoCurrentTurn(State *state, int x, int y, bool force) {
 					// Makes the first valid move that can be made.
 					points = boardPlace(state->board, x, y, state->turn);
 					if (points > 0) {
+						gameRecordMove(state, x, y);
+
 						// Breaks out of the loop.
 						x = BOARD_SIZE;
 						y = BOARD_SIZE;
@@ -290,6 +652,20 @@ void gameNextTurn(State *state) {
 	}
 }
 
+// Adds a move to the record of the game. Once neither player can move, the finished
+// game is added to the games database.
+void gameRecordMove(State *state, int x, int y) {
+	GameRecord *game = &state->game;
+	game->moves[game->moveCount++] = (unsigned char)(x + y * BOARD_SIZE);
+
+	if (!playerCanMove(state->board, PIECE_WHITE) && !playerCanMove(state->board, PIECE_BLACK)) {
+		Bitboard white, black;
+		bitboardFromBoard(state->board, PIECE_WHITE, &white, &black);
+		game->score = (signed char)(bitboardCount(white) - bitboardCount(black));
+		databaseAddGame(game);
+	}
+}
+
 // Checks if a player with the given piece can make a move.
 bool playerCanMove(char board[BOARD_SIZE][BOARD_SIZE], int piece) {
 	for (int x = 0; x < BOARD_SIZE; x++) {
@@ -354,6 +730,19 @@ void boardCopy(char output[BOARD_SIZE][BOARD_SIZE], char input[BOARD_SIZE][BOARD
 	}
 }
 
+// Checks if two boards have the same piece on every tile.
+bool boardEquals(char a[BOARD_SIZE][BOARD_SIZE], char b[BOARD_SIZE][BOARD_SIZE]) {
+	for (int x = 0; x < BOARD_SIZE; x++) {
+		for (int y = 0; y < BOARD_SIZE; y++) {
+			if (a[x][y] != b[x][y]) {
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
 // Checks if the given move is valid and returns the score that would be earned
 // for the given move. The last parameter indicates if any tiles should be changed.
 int boardCheckMove(char board[BOARD_SIZE][BOARD_SIZE], int x, int y, int piece, bool change) {
@@ -493,3 +882,20 @@ void aiTester(State *state, int *pass, int *whiteWins, int *blackWins, int *draw
 		*pass = 0;
 	}
 }
+
+// A function used to calibrate the ProbCut parameters used by the AI's search. The
+// positions reached in games between two AIs are sampled until the given number of
+// games have been played, and the fitted parameters are then saved. The AIs should be
+// strong enough to reach the kind of positions that the deeper searches see.
+void aiCalibrator(State *state, int *pass, int *whiteWins, int *blackWins, int *draws,
+				  int whiteDiff, int blackDiff, int games) {
+	int played = *whiteWins + *blackWins + *draws;
+	aiProbCutSample(state->board, state->turn);
+	aiTester(state, pass, whiteWins, blackWins, draws, whiteDiff, blackDiff);
+
+	// Fit the parameters once the last game has finished.
+	if (*whiteWins + *blackWins + *draws != played &&
+		*whiteWins + *blackWins + *draws == games) {
+		aiProbCutCalibrate(PROBCUT_FILE);
+	}
+}
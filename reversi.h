@@ -1,5 +1,7 @@
 #pragma once
 
+#include <stddef.h>
+
 #define BOARD_SIZE 8
 #define TILE_SIZE 64
 
@@ -9,10 +11,63 @@
 
 #define MOVE_PASS -1
 
+// The highest possible difference between the number of pieces held by each player.
+#define SCORE_MAX (BOARD_SIZE * BOARD_SIZE)
+
+// The number of difficulty levels, each of which limits the AI's search to a budget.
+#define AI_LEVELS 10
+
 #define AI_EASY 1
-#define AI_MEDIUM 2
-#define AI_HARD 3
-#define AI_EXPERT 4
+#define AI_MEDIUM 4
+#define AI_HARD 7
+#define AI_EXPERT AI_LEVELS
+
+// Positions with at most this many empty tiles are solved exactly by the AI.
+#define ENDGAME_EMPTIES 12
+
+// The default number of entries in the cache of solved endgame positions.
+#define ENDGAME_CACHE_SIZE (1 << 18)
+
+// The number of selectivity levels that the AI's search can use.
+#define PROBCUT_SELECTIVITY_LEVELS 6
+
+// A 64-bit set of tiles, where the tile at (x, y) is stored in bit x + y * BOARD_SIZE.
+typedef unsigned long long Bitboard;
+
+#define BITBOARD_TILE(x, y) ((Bitboard)1 << ((x) + (y) * BOARD_SIZE))
+
+// The number of symmetries of the board (rotations and reflections).
+#define BITBOARD_SYMMETRIES 8
+
+// The most moves that can be made in a game, since every move fills an empty tile.
+#define GAME_MAX_MOVES (BOARD_SIZE * BOARD_SIZE - 4)
+
+struct _GameRecord {
+	// The number of moves made in the game, not counting passes.
+	unsigned char moveCount;
+
+	// The number of white pieces minus the number of black pieces once the game ended.
+	signed char score;
+
+	// The index of the tile of each move, where the first move is made by white. A
+	// player passes whenever they can't move, so passes don't need to be recorded.
+	unsigned char moves[GAME_MAX_MOVES];
+};
+
+// Stores the moves and result of a game.
+typedef struct _GameRecord GameRecord;
+
+struct _PositionStats {
+	// The number of games which passed through the position, and how many of them were
+	// won, lost and drawn by the player to move.
+	int games;
+	int wins;
+	int losses;
+	int draws;
+};
+
+// Stores the results of the games which passed through a position.
+typedef struct _PositionStats PositionStats;
 
 struct _State {
 	// The piece on each tile on the board.
@@ -20,12 +75,59 @@ struct _State {
 
 	// The piece of the current player.
 	int turn;
+
+	// The moves made so far in the game.
+	GameRecord game;
 };
 
 // Stores information about the state of a Reversi game.
 typedef struct _State State;
 
-#define STATE_EMPTY { { { 0 } }, 0 }
+#define STATE_EMPTY { { { 0 } }, 0, { 0, 0, { 0 } } }
+
+struct _Move {
+	int x;
+	int y;
+	int score;
+	struct _Move *next;
+};
+
+// Stores information about a move.
+typedef struct _Move Move;
+
+struct _AiBudget {
+	// The deepest that the search can look ahead, in moves.
+	int depth;
+
+	// The most positions that can be searched for a single move.
+	long long nodes;
+
+	// The most random noise that can be added to the score of each position.
+	int noise;
+
+	// The game is solved exactly once at most this many tiles are empty.
+	int solveEmpties;
+
+	// How selective the search is, from zero (every move is searched) up to
+	// PROBCUT_SELECTIVITY_LEVELS - 1 (the most moves are cut off by ProbCut).
+	int selectivity;
+};
+
+// The limits on the AI's search at a difficulty level.
+typedef struct _AiBudget AiBudget;
+
+struct _MappedFile {
+	// The contents of the file and its length in bytes.
+	char *data;
+	size_t length;
+
+	// The handles which keep the file mapped on Windows.
+	void *file;
+	void *mapping;
+};
+
+// Stores a file which has been mapped into memory.
+typedef struct _MappedFile MappedFile;
 
 // Resets the board to the initial state of the game.
 void boardReset(char board[BOARD_SIZE][BOARD_SIZE]);
@@ -33,6 +135,9 @@ void boardReset(char board[BOARD_SIZE][BOARD_SIZE]);
 // Copies the elements of one board to another board.
 void boardCopy(char output[BOARD_SIZE][BOARD_SIZE], char input[BOARD_SIZE][BOARD_SIZE]);
 
+// Checks if two boards have the same piece on every tile.
+bool boardEquals(char a[BOARD_SIZE][BOARD_SIZE], char b[BOARD_SIZE][BOARD_SIZE]);
+
 // Checks if the given move is valid and returns the score that would be earned
 // for the given move. The last parameter indicates if any tiles should be changed.
 int boardCheckMove(char board[BOARD_SIZE][BOARD_SIZE], int x, int y, int piece, bool change);
@@ -45,7 +150,175 @@ int boardPlace(char board[BOARD_SIZE][BOARD_SIZE], int x, int y, int piece);
 int doPieceTurnovers(char board[BOARD_SIZE][BOARD_SIZE], int x, int y, int dx, int dy,
 					 int piece, bool change);
 
+// Converts a board into a pair of bitboards, one holding the pieces of the given
+// player and the other holding the pieces of their opponent.
+void bitboardFromBoard(char board[BOARD_SIZE][BOARD_SIZE], int piece, Bitboard *player,
+					   Bitboard *opponent);
+
+// Gets a bitboard containing every tile that the player can move to.
+Bitboard bitboardGetMoves(Bitboard player, Bitboard opponent);
+
+// Gets a bitboard containing the pieces that would be turned over if the player were
+// to place a piece on the tile with the given index.
+Bitboard bitboardGetFlips(Bitboard player, Bitboard opponent, int index);
+
+// Counts the number of tiles set in a bitboard.
+int bitboardCount(Bitboard bits);
+
+// Gets the index of the lowest tile set in a non-empty bitboard.
+int bitboardFirstIndex(Bitboard bits);
+
+// Gets a bitboard containing the player's pieces which can never be turned over.
+Bitboard bitboardGetStable(Bitboard player, Bitboard opponent);
+
+// Gets a 64-bit hash of a position from the point of view of the player to move.
+Bitboard bitboardHash(Bitboard player, Bitboard opponent);
+
+// Applies one of the BITBOARD_SYMMETRIES symmetries of the board to a bitboard.
+// Symmetry zero leaves the bitboard unchanged.
+Bitboard bitboardTransform(Bitboard bits, int symmetry);
+
+// Undoes one of the symmetries of the board applied by bitboardTransform.
+Bitboard bitboardInverseTransform(Bitboard bits, int symmetry);
+
+// Gets the index of the tile that a tile is moved to by one of the symmetries of the
+// board. MOVE_PASS is left unchanged.
+int bitboardTransformIndex(int index, int symmetry);
+
+// Gets the index of the tile that is moved to the given tile by one of the symmetries
+// of the board. MOVE_PASS is left unchanged.
+int bitboardInverseTransformIndex(int index, int symmetry);
+
+// Replaces a position with its canonical form, which is the same for every position
+// that is symmetric to it. Returns the symmetry that was applied to the position.
+int bitboardCanonicalise(Bitboard *player, Bitboard *opponent);
+
+// Gets a 64-bit hash of a position which is the same for every position that is
+// symmetric to it.
+Bitboard bitboardCanonicalHash(Bitboard player, Bitboard opponent);
+
+// Gets a bitboard containing every tile that the player can move to, leaving out any
+// move which leads to the same position as another move up to symmetry.
+Bitboard bitboardGetUniqueMoves(Bitboard player, Bitboard opponent);
+
 // Calls for the AI to make a move. Inputs the current board along with the difficulty
 // and piece color of the AI. The x and y integer pointers in the function parameters
 // should be changed to output the desired move by the AI.
 void aiMakeMove(char board[BOARD_SIZE][BOARD_SIZE], int difficulty, int piece, int *x, int *y);
+
+// Gets the search budget of the given difficulty level.
+AiBudget aiGetBudget(int level);
+
+// Changes the search budget of the given difficulty level. The selectivity is clamped
+// to the levels that ProbCut has parameters for.
+void aiSetBudget(int level, AiBudget budget);
+
+// Seeds the random number generator used by the AI. If the AI is to be reproducible, it
+// will always make the same moves given the same seed. Its searches then skip the
+// endgame cache, since the positions in it depend on earlier games and on the hints.
+void aiSetSeed(unsigned int seed, bool reproducible);
+
+// Gets a linked list of moves valid for the player with the given piece.
+Move *getValidMoves(char board[BOARD_SIZE][BOARD_SIZE], int piece);
+
+// Frees a linked list of moves from memory.
+void freeMoveList(Move *head);
+
+// Gets the score that the player with the given piece can expect after moving to the
+// given tile, by searching the game tree to the given depth. Once few enough tiles are
+// left empty, the rest of the game is solved exactly instead, sharing the endgame cache
+// with aiMakeMove. The move must be valid. The search is stopped as soon as the given
+// function returns true for the given data, in which case false is returned.
+bool aiAnalyseMove(char board[BOARD_SIZE][BOARD_SIZE], int piece, int x, int y, int depth,
+				   bool (*cancelled)(void *data), void *data, int *score);
+
+// Allocates the cache of solved endgame positions with room for the given number of
+// entries. Only positions with at most the given number of empty tiles are solved.
+bool aiCacheInit(int size, int maxEmpties);
+
+// Maps the cache onto a file, so that the positions solved in earlier runs are used
+// and the positions solved from now on are written back to it. The file is created if
+// it doesn't exist, and is rebuilt if it was saved with a different cache size. This
+// should be called before the cache is used, since the entries are replaced.
+bool aiCacheLoad(const char *filename);
+
+// Saves the solved endgame positions in the cache to a file. If the cache is mapped
+// onto a file, the changes are written back to that file instead.
+bool aiCacheSave(const char *filename);
+
+// Frees the cache of solved endgame positions from memory.
+void aiCacheFree();
+
+// Records the scores of shallow and deep searches of the given position, which are
+// used by aiProbCutCalibrate to fit the ProbCut parameters.
+void aiProbCutSample(char board[BOARD_SIZE][BOARD_SIZE], int piece);
+
+// Fits the ProbCut parameters to the recorded samples and saves them to a file.
+bool aiProbCutCalibrate(const char *filename);
+
+// Loads the ProbCut parameters saved by aiProbCutCalibrate from a file.
+bool aiProbCutLoad(const char *filename);
+
+// Enables or disables recording trace events. Enabling tracing discards any events
+// that were previously recorded. Disabling tracing waits until no other thread is in
+// the middle of recording an event.
+void traceSetEnabled(bool enabled);
+
+// Checks if trace events are being recorded.
+bool traceIsEnabled();
+
+// Records the start of a span of time with the given name on the current thread. The
+// name must point to a string which is never freed.
+void traceBegin(const char *name);
+
+// Records the end of the span of time most recently started on the current thread.
+void traceEnd(const char *name);
+
+// Records the current value of a counter with the given name.
+void traceCounter(const char *name, long long value);
+
+// Saves the recorded trace events to a file in the Chrome trace event format. Tracing
+// is disabled first if it's still enabled.
+bool traceSave(const char *filename);
+
+// Opens a database of game records, creating the file if it doesn't exist. The index
+// is mapped from the second file, and any games added since it was saved are indexed.
+bool databaseOpen(const char *gamesFilename, const char *indexFilename);
+
+// Saves the index of the database to a file, so that the games don't need to be
+// indexed again the next time the database is opened. Nothing is written if no games
+// have been indexed since the index was last saved.
+bool databaseSave(const char *filename);
+
+// Closes the database and frees its index from memory.
+void databaseClose();
+
+// Appends a finished game to the database and returns its ID, or -1 if it couldn't be
+// added.
+int databaseAddGame(const GameRecord *game);
+
+// Gets the number of games in the database.
+int databaseGetGameCount();
+
+// Reads the game with the given ID from the database.
+bool databaseGetGame(int id, GameRecord *game);
+
+// Gets the results of the games which passed through a position or any position
+// symmetric to it, from the point of view of the player with the given piece who is
+// to move. Returns false if no game passed through the position.
+bool databaseGetStats(char board[BOARD_SIZE][BOARD_SIZE], int piece, PositionStats *stats);
+
+// Gets the IDs of the games which passed through a position or any position symmetric
+// to it with the player with the given piece to move, starting with the most recent
+// game. At most the given number of IDs are output, and the number output is returned.
+int databaseGetGames(char board[BOARD_SIZE][BOARD_SIZE], int piece, int *ids, int maxIds);
+
+// Maps a file into memory so that it doesn't need to be copied. If the file is mapped
+// as writable, changes to the memory are written back to the file.
+bool databaseMapFile(const char *filename, bool writable, MappedFile *mapped);
+
+// Writes any changes made to a file mapped as writable back to the disk.
+bool databaseFlushFile(MappedFile *mapped);
+
+// Unmaps a file mapped by databaseMapFile. Does nothing if no file is mapped.
+void databaseUnmapFile(MappedFile *mapped);
@@ -1,261 +1,1098 @@
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
 
 #include "reversi.h"
 
-#define MAX_DEPTH 5
+// Positions with fewer empty tiles than this are cheaper to solve than to look up.
+#define ENDGAME_CACHE_MIN_EMPTIES 4
 
-struct _Move {
-	int x;
-	int y;
-	int score;
-	struct _Move *next;
+// A search which can be cancelled checks if it has been once per this many positions.
+#define SEARCH_CANCEL_INTERVAL 1024
+
+#define CACHE_FILE_MAGIC 0x43455652 // "RVEC"
+#define CACHE_FILE_VERSION 3
+
+// The weights of each feature used to estimate the score of a position.
+#define EVAL_MOBILITY_WEIGHT 2
+#define EVAL_CORNER_WEIGHT 6
+#define EVAL_STABLE_WEIGHT 3
+
+#define BITBOARD_CORNERS 0x8100000000000081ULL
+
+// ProbCut is only used to cut off searches of at least this depth, up to the deepest
+// depth that has been calibrated.
+#define PROBCUT_MIN_DEPTH 2
+#define PROBCUT_MAX_DEPTH 8
+
+// The number of game phases with separate ProbCut parameters.
+#define PROBCUT_PHASES 4
+
+// The number of shallow searches that can be used to predict each deep search. Each
+// check searches two moves deeper than the one before it.
+#define PROBCUT_CHECKS 2
+
+// Each game phase, depth and check needs at least this many samples before it is fitted.
+#define PROBCUT_MIN_SAMPLES 30
+
+#define PROBCUT_FILE_VERSION 2
+
+#define BOUND_EXACT 0
+#define BOUND_LOWER 1
+#define BOUND_UPPER 2
+
+struct _CacheEntry {
+	// The canonical form of the position, from the point of view of the player to move,
+	// with each bitboard XORed with the data. Several threads can use the cache at once
+	// without locking it, since an entry which is only partly written by another thread
+	// no longer matches its position.
+	std::atomic<Bitboard> player;
+	std::atomic<Bitboard> opponent;
+
+	// The result of the position packed by cachePack, or zero if the entry is unused.
+	std::atomic<Bitboard> data;
+};
+
+// Stores the solved result of an endgame position.
+typedef struct _CacheEntry CacheEntry;
+
+struct _EndgameCache {
+	// The entries in the cache, grouped into buckets of two.
+	CacheEntry *entries;
+
+	// The number of entries in the cache (always a power of two).
+	int size;
+
+	// The number of entries in use, and the number of entries which have been
+	// replaced by a different position.
+	std::atomic<int> used;
+	std::atomic<long long> evictions;
+
+	// Positions with at most this many empty tiles are solved exactly.
+	int maxEmpties;
+
+	// The file that the entries are mapped from, unless they are only kept in memory.
+	MappedFile mapping;
+};
+
+// Stores solved endgame positions so that they don't need to be solved again.
+typedef struct _EndgameCache EndgameCache;
+
+struct _CacheFileHeader {
+	unsigned int magic;
+	unsigned int version;
+
+	// The number of entries which follow the header, and the size of each one.
+	unsigned int size;
+	unsigned int entrySize;
+};
+
+// The header at the start of a file containing the entries of the endgame cache.
+typedef struct _CacheFileHeader CacheFileHeader;
+
+struct _ProbCutParams {
+	// The deep search score is predicted to be a + b * (shallow search score), with
+	// the given standard deviation. A standard deviation of zero disables the cut.
+	float a;
+	float b;
+	float sigma;
+};
+
+// Stores the parameters used to predict a deep search from a shallow search.
+typedef struct _ProbCutParams ProbCutParams;
+
+struct _ProbCutSamples {
+	// The sums needed to fit a linear regression of deep scores (y) on shallow
+	// scores (x).
+	double n;
+	double x;
+	double y;
+	double xx;
+	double xy;
+	double yy;
+};
+
+// Stores the scores of shallow and deep searches collected for calibrating ProbCut.
+typedef struct _ProbCutSamples ProbCutSamples;
+
+struct _Search {
+	// The number of positions searched so far, and the most that may be searched.
+	long long nodes;
+	long long maxNodes;
+
+	// Indicates if the search ran out of nodes, in which case its scores are useless.
+	bool aborted;
+
+	// The selectivity level used by ProbCut, where zero disables it.
+	int selectivity;
+
+	// The most random noise that can be added to each evaluation, and the seed used to
+	// generate the noise.
+	int noise;
+	Bitboard seed;
+
+	// Indicates if the search can use the endgame cache shared by every game.
+	bool useCache;
+
+	// Checks if the search has been cancelled by another thread, or NULL if it can't be.
+	bool (*cancelled)(void *data);
+	void *cancelData;
+};
+
+// Stores the limits and progress of a single search.
+typedef struct _Search Search;
+
+// The cache of solved endgame positions shared by every game.
+EndgameCache endgameCache = { NULL, 0, { 0 }, { 0 }, ENDGAME_EMPTIES, { NULL, 0, NULL, NULL } };
+
+// The ProbCut parameters for each game phase, search depth and check. The defaults were
+// fitted by aiCalibrator from 80 games between levels 7 and 8.
+ProbCutParams probCutParams[PROBCUT_PHASES][PROBCUT_MAX_DEPTH + 1][PROBCUT_CHECKS] = {
+	{ { { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f } },
+	  { { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f } },
+	  { { 0.0f, 0.0f, 0.0f }, { -1.59f, 0.36f, 3.91f } },
+	  { { 0.0f, 0.0f, 0.0f }, { 2.51f, 0.30f, 2.47f } },
+	  { { -2.40f, 0.26f, 2.39f }, { -1.94f, 0.35f, 2.28f } },
+	  { { 1.79f, 0.29f, 2.56f }, { 0.20f, 0.73f, 2.02f } },
+	  { { -2.50f, 0.14f, 2.79f }, { -1.90f, 0.38f, 2.38f } },
+	  { { 2.09f, 0.22f, 2.92f }, { 0.03f, 0.80f, 2.12f } },
+	  { { -1.92f, 0.25f, 2.89f }, { -0.41f, 0.76f, 2.27f } } },
+	{ { { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f } },
+	  { { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f } },
+	  { { 0.0f, 0.0f, 0.0f }, { -1.10f, 0.94f, 4.01f } },
+	  { { 0.0f, 0.0f, 0.0f }, { -0.88f, 1.03f, 3.70f } },
+	  { { -1.65f, 1.00f, 5.71f }, { -0.48f, 1.08f, 3.41f } },
+	  { { -1.54f, 1.14f, 5.78f }, { -0.64f, 1.13f, 3.48f } },
+	  { { -1.43f, 1.08f, 7.72f }, { -0.15f, 1.19f, 5.54f } },
+	  { { -1.50f, 1.23f, 7.79f }, { -0.60f, 1.25f, 5.49f } },
+	  { { 0.25f, 1.30f, 7.45f }, { 0.88f, 1.26f, 5.23f } } },
+	{ { { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f } },
+	  { { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f } },
+	  { { 0.0f, 0.0f, 0.0f }, { -0.96f, 1.09f, 7.22f } },
+	  { { 0.0f, 0.0f, 0.0f }, { -0.79f, 1.08f, 7.10f } },
+	  { { -1.84f, 1.17f, 11.13f }, { -0.80f, 1.08f, 7.03f } },
+	  { { -1.51f, 1.16f, 10.99f }, { -0.67f, 1.08f, 6.83f } },
+	  { { -1.85f, 1.23f, 14.52f }, { -0.75f, 1.14f, 10.82f } },
+	  { { -1.03f, 1.21f, 14.72f }, { -0.19f, 1.14f, 10.93f } },
+	  { { -0.39f, 1.19f, 14.46f }, { 0.52f, 1.12f, 10.36f } } },
+	{ { { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f } },
+	  { { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f } },
+	  { { 0.0f, 0.0f, 0.0f }, { 0.60f, 0.94f, 15.29f } },
+	  { { 0.0f, 0.0f, 0.0f }, { -1.49f, 0.94f, 14.23f } },
+	  { { 0.44f, 0.86f, 20.21f }, { -0.12f, 0.93f, 13.69f } },
+	  { { -1.77f, 0.86f, 19.26f }, { -0.43f, 0.93f, 13.34f } },
+	  { { 0.63f, 0.79f, 22.96f }, { 0.11f, 0.85f, 18.37f } },
+	  { { -1.43f, 0.78f, 21.90f }, { -0.22f, 0.84f, 17.78f } },
+	  { { 0.61f, 0.77f, 20.72f }, { 0.71f, 0.83f, 17.02f } } }
+};
+
+// The samples collected for calibrating each game phase, search depth and check.
+ProbCutSamples probCutSamples[PROBCUT_PHASES][PROBCUT_MAX_DEPTH + 1][PROBCUT_CHECKS];
+
+// The number of standard deviations that a prediction must be beyond the search window
+// for each selectivity level. Lower values cut off more of the game tree.
+const float probCutConfidence[PROBCUT_SELECTIVITY_LEVELS] = { 0.0f, 3.3f, 2.6f, 2.0f, 1.5f, 1.1f };
+
+// The search budget of each difficulty level, from AI_EASY up to AI_EXPERT. ProbCut
+// only pays off once the node budget limits the search more than its depth does, and
+// in self-play it only held its own against a full search at the expert level.
+AiBudget aiBudgets[AI_LEVELS] = {
+	// depth, nodes, noise, solveEmpties, selectivity
+	{ 1, 1000, 32, 0, 0 },
+	{ 1, 1000, 16, 0, 0 },
+	{ 2, 2000, 12, 0, 0 },
+	{ 2, 5000, 8, 0, 0 },
+	{ 3, 10000, 6, 4, 0 },
+	{ 4, 25000, 4, 6, 0 },
+	{ 5, 50000, 2, 8, 0 },
+	{ 6, 150000, 1, 10, 0 },
+	{ 7, 300000, 0, ENDGAME_EMPTIES, 0 },
+	{ 8, 500000, 0, ENDGAME_EMPTIES, 1 },
 };
 
-// Stores information about a move.
-typedef struct _Move Move;
+// The state of the random number generator used to seed each search.
+Bitboard aiRandomState = 0x9E3779B97F4A7C15ULL;
+
+// Indicates if the AI's moves should only depend on the seed, in which case they don't
+// use the endgame cache.
+bool aiReproducible = false;
 
 // Function prototypes.
-void aiMakeMove_Easy(char board[BOARD_SIZE][BOARD_SIZE], Move *validMoves, int piece,
-					 int *x, int *y);
-void aiMakeMove_Medium(char board[BOARD_SIZE][BOARD_SIZE], Move *validMoves, int piece,
-					   int *x, int *y);
-void aiMakeMove_Hard(char board[BOARD_SIZE][BOARD_SIZE], Move *validMoves, int piece,
-					 int *x, int *y);
-void aiMakeMove_Expert(char board[BOARD_SIZE][BOARD_SIZE], Move *validMoves, int piece,
-					   int *x, int *y);
-
-Move *getValidMoves(char board[BOARD_SIZE][BOARD_SIZE], int piece);
-Move getBestMove(char board[BOARD_SIZE][BOARD_SIZE], int piece, int depth);
-int getHighestScoringMove(char board[BOARD_SIZE][BOARD_SIZE], int piece);
+bool searchRoot(Search *search, Bitboard player, Bitboard opponent, int depth, bool solve,
+				int *bestIndex);
+int searchPosition(Search *search, Bitboard player, Bitboard opponent, int depth, int alpha,
+				   int beta, bool passed);
+bool searchOutOfNodes(Search *search);
+int evaluatePosition(Search *search, Bitboard player, Bitboard opponent);
+bool probCut(Search *search, Bitboard player, Bitboard opponent, int depth, int alpha, int beta,
+			 int *score);
+int getShallowDepth(int depth, int check);
+int getPhase(Bitboard player, Bitboard opponent);
+bool stabilityCutoff(Bitboard player, Bitboard opponent, int alpha, int *score);
+int solveEndgame(Search *search, Bitboard player, Bitboard opponent, int alpha, int beta,
+				 bool passed, int *bestMove);
+int getFinalScore(Bitboard player, Bitboard opponent);
+Bitboard aiNextRandom();
 
-Move *insertMove(Move *head, int x, int y, int score);
-void freeMoveList(Move *head);
+bool cacheProbe(Bitboard player, Bitboard opponent, int *score, int *bound, int *move);
+void cacheStore(Bitboard player, Bitboard opponent, int empties, int score, int bound,
+				int move);
+Bitboard cachePack(int empties, int score, int bound, int move);
+bool cacheMapFile(const char *filename);
+void cacheImportFile(const char *filename);
+bool cacheWriteFile(const char *filename);
+bool cacheReadHeader(MappedFile *mapped, CacheFileHeader *header);
 
-int getOpponentPiece(int piece);
+Move *insertMove(Move *head, int x, int y, int score);
 
 // Calls for the AI to make a move. Inputs the current board along with the difficulty
 // and piece color of the AI. The x and y integer pointers in the function parameters
 // should be changed to output the desired move by the AI.
+//
+// Every difficulty level uses the same search, limited by the budget of that level.
+// The search deepens one level at a time until it reaches the level's depth or runs
+// out of nodes, and the best move from the deepest finished search is played. Once few
+// enough tiles are left empty, the rest of the game is also solved exactly, and the
+// move from the solver is played if it finishes within the budget.
 void aiMakeMove(char board[BOARD_SIZE][BOARD_SIZE], int difficulty, int piece, int *x, int *y) {
-	// Get a linked list containing each valid move.
-	Move *validMoves = getValidMoves(board, piece);
+	traceBegin("aiMakeMove");
 
-	switch (difficulty) {
-		case AI_EASY:
-			aiMakeMove_Easy(board, validMoves, piece, x, y);
-			break;
-		case AI_MEDIUM:
-			aiMakeMove_Medium(board, validMoves, piece, x, y);
-			break;
-		case AI_HARD:
-			aiMakeMove_Hard(board, validMoves, piece, x, y);
-			break;
-		case AI_EXPERT:
-			aiMakeMove_Expert(board, validMoves, piece, x, y);
-			break;
+	AiBudget budget = aiGetBudget(difficulty);
+	Bitboard player, opponent;
+	bitboardFromBoard(board, piece, &player, &opponent);
+
+	*x = MOVE_PASS;
+	*y = MOVE_PASS;
+
+	Bitboard moves = bitboardGetMoves(player, opponent);
+	if (moves != 0) {
+		Search search = { 0, budget.nodes, false, budget.selectivity, budget.noise, aiNextRandom(),
+			!aiReproducible, NULL, NULL };
+		int index = bitboardFirstIndex(moves);
+
+		// If the endgame is to be solved, the normal search is limited to half of the
+		// budget. Its move is played if the rest of the budget runs out before the
+		// endgame is solved.
+		int empties = SCORE_MAX - bitboardCount(player | opponent);
+		bool solve = empties <= budget.solveEmpties && empties <= endgameCache.maxEmpties;
+		if (solve) {
+			search.maxNodes = budget.nodes / 2;
+		}
+
+		for (int i = 1; i <= budget.depth; i++) {
+			traceBegin("searchIteration");
+			bool finished = searchRoot(&search, player, opponent, i, false, &index);
+			traceEnd("searchIteration");
+			if (!finished) {
+				break;
+			}
+		}
+
+		if (solve) {
+			search.maxNodes = budget.nodes;
+			search.aborted = false;
+			traceBegin("solveEndgame");
+			searchRoot(&search, player, opponent, empties, true, &index);
+			traceEnd("solveEndgame");
+		}
+
+		*x = index % BOARD_SIZE;
+		*y = index / BOARD_SIZE;
+		traceCounter("searchNodes", search.nodes);
 	}
 
-	// Free the list of valid moves from memory.
-	freeMoveList(validMoves);
+	traceCounter("endgameCacheUsed", endgameCache.used.load(std::memory_order_relaxed));
+	traceCounter("endgameCacheEvictions", endgameCache.evictions.load(std::memory_order_relaxed));
+	traceEnd("aiMakeMove");
 }
 
-// Calls for the easy difficulty AI to make a move. This AI will simply
-// choose a random valid move.
-void aiMakeMove_Easy(char board[BOARD_SIZE][BOARD_SIZE], Move *validMoves, int piece,
-					 int *x, int *y) {
-	// Counts the number of valid moves.
-	int count = 0;
-	Move *move = validMoves;
-	while (move != NULL) {
-		count++;
-		move = move->next;
+// Gets the search budget of the given difficulty level.
+AiBudget aiGetBudget(int level) {
+	if (level < 1) {
+		level = 1;
+	} else if (level > AI_LEVELS) {
+		level = AI_LEVELS;
+	}
+
+	return aiBudgets[level - 1];
+}
+
+// Changes the search budget of the given difficulty level. The selectivity is clamped
+// to the levels that ProbCut has parameters for.
+void aiSetBudget(int level, AiBudget budget) {
+	if (budget.selectivity < 0) {
+		budget.selectivity = 0;
+	} else if (budget.selectivity >= PROBCUT_SELECTIVITY_LEVELS) {
+		budget.selectivity = PROBCUT_SELECTIVITY_LEVELS - 1;
 	}
 
-	if (count > 0) {
-		// Selects a move randomly.
-		int index = rand() % count;
-		move = validMoves;
-		for (int i = 0; i < index; i++) {
-			move = move->next;
+	if (level >= 1 && level <= AI_LEVELS) {
+		aiBudgets[level - 1] = budget;
+	}
+}
+
+// Seeds the random number generator used by the AI. If the AI is to be reproducible, it
+// will always make the same moves given the same seed. Its searches then skip the
+// endgame cache, since the positions in it depend on earlier games and on the hints.
+void aiSetSeed(unsigned int seed, bool reproducible) {
+	aiRandomState = bitboardHash(seed, 0);
+	aiReproducible = reproducible;
+}
+
+// Gets the next number from the AI's random number generator (xorshift64*).
+Bitboard aiNextRandom() {
+	aiRandomState ^= aiRandomState >> 12;
+	aiRandomState ^= aiRandomState << 25;
+	aiRandomState ^= aiRandomState >> 27;
+	return aiRandomState * 0x2545F4914F6CDD1DULL;
+}
+
+// Gets a linked list of moves valid for the player with the given piece.
+Move *getValidMoves(char board[BOARD_SIZE][BOARD_SIZE], int piece) {
+	Move *validMoves = NULL;
+	for (int x = 0; x < BOARD_SIZE; x++) {
+		for (int y = 0; y < BOARD_SIZE; y++) {
+			int score = boardCheckMove(board, x, y, piece, false);
+			if (score > 0) {
+				validMoves = insertMove(validMoves, x, y, score);
+			}
 		}
+	}
+
+	return validMoves;
+}
+
+// Gets the score that the player with the given piece can expect after moving to the
+// given tile, by searching the game tree to the given depth. Once few enough tiles are
+// left empty, the rest of the game is solved exactly instead, sharing the endgame cache
+// with aiMakeMove. The move must be valid. The search is stopped as soon as the given
+// function returns true for the given data, in which case false is returned.
+bool aiAnalyseMove(char board[BOARD_SIZE][BOARD_SIZE], int piece, int x, int y, int depth,
+				   bool (*cancelled)(void *data), void *data, int *score) {
+	traceBegin("aiAnalyseMove");
+
+	Bitboard player, opponent;
+	bitboardFromBoard(board, piece, &player, &opponent);
 
-		*x = move->x;
-		*y = move->y;
+	int index = x + y * BOARD_SIZE;
+	Bitboard flips = bitboardGetFlips(player, opponent, index);
+	Bitboard newPlayer = player | flips | ((Bitboard)1 << index);
+	Bitboard newOpponent = opponent & ~flips;
+	Search search = { 0, LLONG_MAX, false, aiGetBudget(AI_EXPERT).selectivity, 0, 0, true,
+		cancelled, data };
+	int empties = SCORE_MAX - bitboardCount(newPlayer | newOpponent);
+	if (empties <= endgameCache.maxEmpties) {
+		*score = -solveEndgame(&search, newOpponent, newPlayer, -SCORE_MAX - 1, SCORE_MAX + 1,
+							   false, NULL);
 	} else {
-		*x = MOVE_PASS;
-		*y = MOVE_PASS;
+		*score = -searchPosition(&search, newOpponent, newPlayer, depth - 1, -SCORE_MAX - 1,
+								 SCORE_MAX + 1, false);
 	}
+
+	traceEnd("aiAnalyseMove");
+	return !search.aborted;
 }
 
-// Calls for the medium difficulty AI to make a move. This AI will simply choose
-// a valid move that yields the most amount of points.
-void aiMakeMove_Medium(char board[BOARD_SIZE][BOARD_SIZE], Move *validMoves, int piece,
-					   int *x, int *y) {
-	// Find the move which grants the highest score.
-	int count = 0;
-	Move *best = NULL;
-	Move *move = validMoves;
-	while (move != NULL) {
-		if (best == NULL || move->score > best->score) {
-			best = move;
-			count = 1;
-		} else if (move->score == best->score) {
-			count++;
+// Searches every valid move using a minimax algorithm with alpha-beta pruning, either
+// to the given depth or, if the last parameter is set, to the end of the game. The
+// move in the last parameter is searched first and replaced by the best move found.
+// Returns false if the search ran out of nodes, in which case the move is unchanged.
+// Moves which are symmetric to another move lead to the same result, so only one of
+// them is searched.
+bool searchRoot(Search *search, Bitboard player, Bitboard opponent, int depth, bool solve,
+				int *bestIndex) {
+	Bitboard moves = bitboardGetUniqueMoves(player, opponent);
+	int best = -SCORE_MAX - 1;
+	int bestFound = *bestIndex;
+	int index = (moves & ((Bitboard)1 << *bestIndex)) != 0 ? *bestIndex : bitboardFirstIndex(moves);
+	while (moves != 0) {
+		moves &= ~((Bitboard)1 << index);
+
+		Bitboard flips = bitboardGetFlips(player, opponent, index);
+		Bitboard newPlayer = player | flips | ((Bitboard)1 << index);
+		Bitboard newOpponent = opponent & ~flips;
+		traceBegin("searchMove");
+		int score;
+		if (solve) {
+			score = -solveEndgame(search, newOpponent, newPlayer, -SCORE_MAX - 1, -best, false, NULL);
+		} else {
+			score = -searchPosition(search, newOpponent, newPlayer, depth - 1, -SCORE_MAX - 1,
+									-best, false);
+		}
+		traceEnd("searchMove");
+
+		if (search->aborted) {
+			return false;
 		}
 
-		move = move->next;
+		if (score > best) {
+			best = score;
+			bestFound = index;
+		}
+
+		if (moves != 0) {
+			index = bitboardFirstIndex(moves);
+		}
 	}
 
-	if (best != NULL) {
-		// If there is more than one move which gives the highest score, then 
-		// choose one of those moves randomly to have variation in play.
-		int index = rand() % count;
-		move = validMoves;
-		while (index >= 0) {
-			if (move->score == best->score) {
-				index--;
-			}
+	*bestIndex = bestFound;
+	return true;
+}
+
+// Searches the game tree to the given depth and returns the score of the position for
+// the player to move. Scores outside of the range from alpha to beta are only bounds.
+int searchPosition(Search *search, Bitboard player, Bitboard opponent, int depth, int alpha,
+				   int beta, bool passed) {
+	if (searchOutOfNodes(search)) {
+		return 0;
+	}
+
+	Bitboard moves = bitboardGetMoves(player, opponent);
+	if (moves == 0) {
+		// The game is over once neither player can move.
+		if (passed) {
+			return getFinalScore(player, opponent);
+		}
+
+		return -searchPosition(search, opponent, player, depth, -beta, -alpha, true);
+	}
+
+	if (depth <= 0) {
+		return evaluatePosition(search, player, opponent);
+	}
 
-			if (index >= 0) {
-				move = move->next;
+	// The stability cutoff isn't used here, since it bounds the final score and not the
+	// estimates returned by evaluatePosition.
+	int score;
+	if (probCut(search, player, opponent, depth, alpha, beta, &score)) {
+		return score;
+	}
+
+	if (search->aborted) {
+		return 0;
+	}
+
+	int best = -SCORE_MAX - 1;
+	while (moves != 0) {
+		int index = bitboardFirstIndex(moves);
+		moves &= moves - 1;
+
+		Bitboard flips = bitboardGetFlips(player, opponent, index);
+		Bitboard newPlayer = player | flips | ((Bitboard)1 << index);
+		Bitboard newOpponent = opponent & ~flips;
+		score = -searchPosition(search, newOpponent, newPlayer, depth - 1, -beta, -alpha, false);
+		if (search->aborted) {
+			return 0;
+		}
+
+		if (score > best) {
+			best = score;
+			if (score > alpha) {
+				alpha = score;
+				if (alpha >= beta) {
+					break;
+				}
 			}
 		}
+	}
 
-		*x = move->x;
-		*y = move->y;
-	} else {
-		*x = MOVE_PASS;
-		*y = MOVE_PASS;
+	return best;
+}
+
+// Counts a position as searched and returns a value indicating if the search has run
+// out of nodes or been cancelled.
+bool searchOutOfNodes(Search *search) {
+	if (search->nodes++ >= search->maxNodes) {
+		search->aborted = true;
+	} else if (search->cancelled != NULL && search->nodes % SEARCH_CANCEL_INTERVAL == 0 &&
+			   search->cancelled(search->cancelData)) {
+		search->aborted = true;
 	}
+
+	return search->aborted;
 }
 
-// Calls for the hard difficulty AI to make a move. This AI will look one move
-// ahead and choose a valid move that has the greatest difference between the
-// highest score the AI can earn and the highest score the opponent can earn.
-void aiMakeMove_Hard(char board[BOARD_SIZE][BOARD_SIZE], Move *validMoves, int piece,
-					 int *x, int *y) {
-	int count = 0;
-	Move *best = NULL;
-	Move *move = validMoves;
-	while (move != NULL) {
-		// Create a fake board simulating the move.
-		char tempBoard[BOARD_SIZE][BOARD_SIZE];
-		boardCopy(tempBoard, board);
-		boardPlace(tempBoard, move->x, move->y, piece);
-
-		// Get the difference between the score earned by this move and the highest move that
-		// the opponent can make in the next turn. If this difference is higher than the
-		// largest difference currently found, then update the new best move.
-		int opponent = getOpponentPiece(piece);
-		move->score -= getHighestScoringMove(tempBoard, opponent);
-		if (best == NULL || move->score > best->score) {
-			best = move;
-			best->score == move->score;
-			count = 1;
-		} else if (move->score == best->score) {
-			count++;
+// Estimates the score of a position for the player to move, based on how many moves
+// each player has and how many of their pieces are in corners or can never be turned
+// over. The search's random noise is added to the estimate, which is then kept within
+// the range of possible final scores. The noise depends only on the position and the
+// seed, so the same position is always given the same score within a search.
+int evaluatePosition(Search *search, Bitboard player, Bitboard opponent) {
+	int mobility = bitboardCount(bitboardGetMoves(player, opponent)) -
+		bitboardCount(bitboardGetMoves(opponent, player));
+	int corners = bitboardCount(player & BITBOARD_CORNERS) -
+		bitboardCount(opponent & BITBOARD_CORNERS);
+	int stable = bitboardCount(bitboardGetStable(player, opponent)) -
+		bitboardCount(bitboardGetStable(opponent, player));
+
+	int score = mobility * EVAL_MOBILITY_WEIGHT + corners * EVAL_CORNER_WEIGHT +
+		stable * EVAL_STABLE_WEIGHT;
+	if (search->noise > 0) {
+		Bitboard random = bitboardHash(player, opponent) ^ search->seed;
+		score += (int)(random % (2 * search->noise + 1)) - search->noise;
+	}
+
+	if (score >= SCORE_MAX) {
+		return SCORE_MAX - 1;
+	} else if (score <= -SCORE_MAX) {
+		return -SCORE_MAX + 1;
+	}
+
+	return score;
+}
+
+// Checks if the opponent has enough stable pieces that the player can't finish with a
+// score above alpha. If so, the highest score the player could still finish with is
+// written to the last parameter so that the search can stop early.
+bool stabilityCutoff(Bitboard player, Bitboard opponent, int alpha, int *score) {
+	// The opponent can't have more stable pieces than pieces, so avoid finding the
+	// stable pieces when there could never be enough of them.
+	if (SCORE_MAX - 2 * bitboardCount(opponent) > alpha) {
+		return false;
+	}
+
+	int upperBound = SCORE_MAX - 2 * bitboardCount(bitboardGetStable(opponent, player));
+	if (upperBound <= alpha) {
+		*score = upperBound;
+		return true;
+	}
+
+	return false;
+}
+
+// Checks if shallow searches predict that a search of the given depth would fall
+// outside of the search window (Multi-ProbCut). Each check uses a deeper and more
+// expensive search than the one before it, and the first check which predicts the
+// result stops the rest. If the result is predicted, the bound that it would fall past
+// is written to the last parameter so that the search can stop early.
+bool probCut(Search *search, Bitboard player, Bitboard opponent, int depth, int alpha, int beta,
+			 int *score) {
+	if (search->selectivity <= 0 || depth < PROBCUT_MIN_DEPTH || depth > PROBCUT_MAX_DEPTH) {
+		return false;
+	}
+
+	int phase = getPhase(player, opponent);
+	for (int check = 0; check < PROBCUT_CHECKS; check++) {
+		int shallowDepth = getShallowDepth(depth, check);
+		ProbCutParams *params = &probCutParams[phase][depth][check];
+		if (shallowDepth < 0 || params->sigma <= 0.0f || params->b <= 0.0f) {
+			continue;
 		}
 
-		move = move->next;
+		float margin = probCutConfidence[search->selectivity] * params->sigma;
+
+		// Check if the deep search is likely to fail high, i.e. a + b * v - margin >= beta.
+		int bound = (int)ceil((beta + margin - params->a) / params->b);
+		if (bound < SCORE_MAX && searchPosition(search, player, opponent, shallowDepth,
+												bound - 1, bound, false) >= bound) {
+			*score = beta;
+			return true;
+		}
+
+		// Check if the deep search is likely to fail low, i.e. a + b * v + margin <= alpha.
+		bound = (int)floor((alpha - margin - params->a) / params->b);
+		if (bound > -SCORE_MAX && searchPosition(search, player, opponent, shallowDepth,
+												 bound, bound + 1, false) <= bound) {
+			*score = alpha;
+			return true;
+		}
+
+		if (search->aborted) {
+			return false;
+		}
+	}
+
+	return false;
+}
+
+// Gets the depth of the shallow search used by the given check to predict a search of
+// the given depth, or -1 if the check isn't used at that depth. The shallow depths keep
+// the same parity since scores tend to swing between odd and even depths.
+int getShallowDepth(int depth, int check) {
+	int shallowDepth = (depth / 4) * 2 + (depth % 2) - 2 * (PROBCUT_CHECKS - 1 - check);
+	return shallowDepth >= 0 ? shallowDepth : -1;
+}
+
+// Gets the game phase of a position for looking up its ProbCut parameters.
+int getPhase(Bitboard player, Bitboard opponent) {
+	int phase = (bitboardCount(player | opponent) - 4) * PROBCUT_PHASES / (SCORE_MAX - 4);
+	return phase < PROBCUT_PHASES ? phase : PROBCUT_PHASES - 1;
+}
+
+// Records the scores of shallow and deep searches of the given position, which are
+// used by aiProbCutCalibrate to fit the ProbCut parameters.
+void aiProbCutSample(char board[BOARD_SIZE][BOARD_SIZE], int piece) {
+	Bitboard player, opponent;
+	bitboardFromBoard(board, piece, &player, &opponent);
+	if (bitboardGetMoves(player, opponent) == 0) {
+		return;
+	}
+
+	// Every search is done without ProbCut so that it doesn't skew the predictions.
+	Search search = { 0, LLONG_MAX, false, 0, 0, 0, true, NULL, NULL };
+
+	int phase = getPhase(player, opponent);
+	int scores[PROBCUT_MAX_DEPTH + 1];
+	for (int depth = 0; depth <= PROBCUT_MAX_DEPTH; depth++) {
+		scores[depth] = searchPosition(&search, player, opponent, depth, -SCORE_MAX - 1,
+									   SCORE_MAX + 1, false);
+	}
+
+	for (int depth = PROBCUT_MIN_DEPTH; depth <= PROBCUT_MAX_DEPTH; depth++) {
+		for (int check = 0; check < PROBCUT_CHECKS; check++) {
+			int shallowDepth = getShallowDepth(depth, check);
+			if (shallowDepth < 0) {
+				continue;
+			}
+
+			double x = scores[shallowDepth];
+			double y = scores[depth];
+
+			ProbCutSamples *samples = &probCutSamples[phase][depth][check];
+			samples->n++;
+			samples->x += x;
+			samples->y += y;
+			samples->xx += x * x;
+			samples->xy += x * y;
+			samples->yy += y * y;
+		}
 	}
+}
 
-	if (best != NULL) {
-		int index = rand() % count;
-		move = validMoves;
-		while (index >= 0) {
-			if (move->score == best->score) {
-				index--;
+// Fits the ProbCut parameters to the samples recorded by aiProbCutSample with a
+// linear regression, then saves them to a file so that they can be loaded later.
+bool aiProbCutCalibrate(const char *filename) {
+	for (int phase = 0; phase < PROBCUT_PHASES; phase++) {
+		for (int i = 0; i < (PROBCUT_MAX_DEPTH + 1) * PROBCUT_CHECKS; i++) {
+			int depth = i / PROBCUT_CHECKS;
+			int check = i % PROBCUT_CHECKS;
+			ProbCutSamples *samples = &probCutSamples[phase][depth][check];
+			if (samples->n < PROBCUT_MIN_SAMPLES) {
+				continue;
 			}
 
-			if (index >= 0) {
-				move = move->next;
+			double n = samples->n;
+			double varianceX = samples->xx - samples->x * samples->x / n;
+			double covariance = samples->xy - samples->x * samples->y / n;
+			if (varianceX <= 0.0) {
+				continue;
 			}
+
+			double b = covariance / varianceX;
+			double a = (samples->y - b * samples->x) / n;
+
+			// The residual variance is what's left of the variance of the deep scores
+			// after removing the part explained by the shallow scores.
+			double residual = (samples->yy - samples->y * samples->y / n - b * covariance) / (n - 2);
+
+			ProbCutParams *params = &probCutParams[phase][depth][check];
+			params->a = (float)a;
+			params->b = (float)b;
+			params->sigma = (float)sqrt(residual > 0.0 ? residual : 0.0);
 		}
+	}
 
-		*x = move->x;
-		*y = move->y;
-	} else {
-		*x = MOVE_PASS;
-		*y = MOVE_PASS;
+	FILE *file = fopen(filename, "w");
+	if (file == NULL) {
+		fprintf(stderr, "Unable to save the ProbCut parameters to %s\n", filename);
+		return false;
+	}
+
+	fprintf(file, "probcut %d\n", PROBCUT_FILE_VERSION);
+	for (int phase = 0; phase < PROBCUT_PHASES; phase++) {
+		for (int depth = PROBCUT_MIN_DEPTH; depth <= PROBCUT_MAX_DEPTH; depth++) {
+			for (int check = 0; check < PROBCUT_CHECKS; check++) {
+				ProbCutParams *params = &probCutParams[phase][depth][check];
+				fprintf(file, "%d %d %d %f %f %f\n", phase, depth, check, params->a, params->b,
+						params->sigma);
+			}
+		}
 	}
+
+	fclose(file);
+	return true;
 }
 
-// Calls for the expert difficulty AI to make a move. This AI will analyse a game tree
-// up to a predefined maximum depth and use minimax to determine the best move.
-void aiMakeMove_Expert(char board[BOARD_SIZE][BOARD_SIZE], Move *validMoves, int piece,
-					 int *x, int *y) {
-	Move move = getBestMove(board, piece, 0);
-	*x = move.x;
-	*y = move.y;
+// Loads the ProbCut parameters saved by aiProbCutCalibrate from a file.
+bool aiProbCutLoad(const char *filename) {
+	FILE *file = fopen(filename, "r");
+	if (file == NULL) {
+		return false;
+	}
+
+	int version;
+	if (fscanf(file, "probcut %d", &version) != 1 || version != PROBCUT_FILE_VERSION) {
+		fprintf(stderr, "Ignoring invalid ProbCut file %s\n", filename);
+		fclose(file);
+		return false;
+	}
+
+	int phase, depth, check;
+	ProbCutParams params;
+	while (fscanf(file, "%d %d %d %f %f %f", &phase, &depth, &check, &params.a, &params.b,
+				  &params.sigma) == 6) {
+		if (phase >= 0 && phase < PROBCUT_PHASES && depth >= 0 && depth <= PROBCUT_MAX_DEPTH &&
+			check >= 0 && check < PROBCUT_CHECKS) {
+			probCutParams[phase][depth][check] = params;
+		}
+	}
+
+	fclose(file);
+	return true;
 }
 
-// Gets a linked list of moves valid for the player with the given piece.
-Move *getValidMoves(char board[BOARD_SIZE][BOARD_SIZE], int piece) {
-	Move *validMoves = NULL;
-	for (int x = 0; x < BOARD_SIZE; x++) {
-		for (int y = 0; y < BOARD_SIZE; y++) {
-			int score = boardCheckMove(board, x, y, piece, false);
-			if (score > 0) {
-				validMoves = insertMove(validMoves, x, y, score);
+// Solves an endgame position with an alpha-beta search to the end of the game and
+// returns the final score for the player to move. The index of the best tile to move
+// to is written to the last parameter if it isn't NULL.
+int solveEndgame(Search *search, Bitboard player, Bitboard opponent, int alpha, int beta,
+				 bool passed, int *bestMove) {
+	if (searchOutOfNodes(search)) {
+		return 0;
+	}
+
+	Bitboard moves = bitboardGetMoves(player, opponent);
+	if (moves == 0) {
+		if (bestMove != NULL) {
+			*bestMove = MOVE_PASS;
+		}
+
+		// The game is over once neither player can move.
+		if (passed) {
+			return getFinalScore(player, opponent);
+		}
+
+		return -solveEndgame(search, opponent, player, -beta, -alpha, true, NULL);
+	}
+
+	// Look for the result of a previous search of this position. Symmetric positions
+	// share the entry of their canonical form, whose move has to be mapped back.
+	int empties = SCORE_MAX - bitboardCount(player | opponent);
+	Bitboard canonicalPlayer = player;
+	Bitboard canonicalOpponent = opponent;
+	int symmetry = 0;
+	int score, bound;
+	int cachedMove = MOVE_PASS;
+	bool cacheable = search->useCache && empties >= ENDGAME_CACHE_MIN_EMPTIES;
+	bool cached = false;
+	if (cacheable) {
+		symmetry = bitboardCanonicalise(&canonicalPlayer, &canonicalOpponent);
+		cached = cacheProbe(canonicalPlayer, canonicalOpponent, &score, &bound, &cachedMove);
+	}
+
+	if (cached) {
+		cachedMove = bitboardInverseTransformIndex(cachedMove, symmetry);
+		if (bound == BOUND_EXACT || (bound == BOUND_LOWER && score >= beta) ||
+			(bound == BOUND_UPPER && score <= alpha)) {
+			if (bestMove != NULL) {
+				*bestMove = cachedMove;
 			}
+
+			return score;
 		}
 	}
 
-	return validMoves;
+	if (stabilityCutoff(player, opponent, alpha, &score)) {
+		return score;
+	}
+
+	// Search the best move from the previous search first.
+	int first = cachedMove >= 0 ? cachedMove : bitboardFirstIndex(moves);
+	int originalAlpha = alpha;
+	int best = -SCORE_MAX - 1;
+	int bestIndex = first;
+	int index = first;
+	while (moves != 0) {
+		moves &= ~((Bitboard)1 << index);
+
+		Bitboard flips = bitboardGetFlips(player, opponent, index);
+		Bitboard newPlayer = player | flips | ((Bitboard)1 << index);
+		Bitboard newOpponent = opponent & ~flips;
+		score = -solveEndgame(search, newOpponent, newPlayer, -beta, -alpha, false, NULL);
+		if (search->aborted) {
+			return 0;
+		}
+
+		if (score > best) {
+			best = score;
+			bestIndex = index;
+			if (score > alpha) {
+				alpha = score;
+				if (alpha >= beta) {
+					break;
+				}
+			}
+		}
+
+		if (moves != 0) {
+			index = bitboardFirstIndex(moves);
+		}
+	}
+
+	if (cacheable) {
+		bound = best <= originalAlpha ? BOUND_UPPER : best >= beta ? BOUND_LOWER : BOUND_EXACT;
+		cacheStore(canonicalPlayer, canonicalOpponent, empties, best, bound,
+				   bitboardTransformIndex(bestIndex, symmetry));
+	}
+
+	if (bestMove != NULL) {
+		*bestMove = bestIndex;
+	}
+
+	return best;
 }
 
-// Gets the best move that a player can make using a minimax algorithm.
-Move getBestMove(char board[BOARD_SIZE][BOARD_SIZE], int piece, int depth) {
-	if (depth > MAX_DEPTH) {
-		Move move = { MOVE_PASS, MOVE_PASS, 0, NULL };
-		return move;
+// Gets the final score of a finished game for the player to move. Any empty tiles
+// are counted towards the winner.
+int getFinalScore(Bitboard player, Bitboard opponent) {
+	int playerCount = bitboardCount(player);
+	int opponentCount = bitboardCount(opponent);
+	int empties = SCORE_MAX - playerCount - opponentCount;
+	if (playerCount > opponentCount) {
+		playerCount += empties;
+	} else if (opponentCount > playerCount) {
+		opponentCount += empties;
 	}
 
-	Move *validMoves = getValidMoves(board, piece);
+	return playerCount - opponentCount;
+}
 
-	// Find the move which grants the highest score.
-	Move best = { MOVE_PASS, MOVE_PASS, 0, NULL };
-	Move *move = validMoves;
-	while (move != NULL) {
-		// Create a fake board simulating the move.
-		char tempBoard[BOARD_SIZE][BOARD_SIZE];
-		boardCopy(tempBoard, board);
-		boardPlace(tempBoard, move->x, move->y, piece);
-
-		int opponent = getOpponentPiece(piece);
-		Move m = getBestMove(tempBoard, opponent, depth + 1);
-		int score = move->score - m.score;
-		if (best.x == MOVE_PASS || score > best.score) {
-			best.x = move->x;
-			best.y = move->y;
-			best.score = score;
+// Allocates the cache of solved endgame positions with room for the given number of
+// entries. Only positions with at most the given number of empty tiles are solved.
+bool aiCacheInit(int size, int maxEmpties) {
+	aiCacheFree();
+
+	// Round the size down to a power of two so that entries can be indexed by a mask.
+	int actualSize = 2;
+	while (actualSize * 2 <= size) {
+		actualSize *= 2;
+	}
+
+	endgameCache.entries = (CacheEntry*)calloc(actualSize, sizeof(CacheEntry));
+	if (endgameCache.entries == NULL) {
+		fprintf(stderr, "Unable to allocate the endgame cache!\n");
+		return false;
+	}
+
+	endgameCache.size = actualSize;
+	endgameCache.used = 0;
+	endgameCache.evictions = 0;
+	endgameCache.maxEmpties = maxEmpties;
+	return true;
+}
+
+// Maps the cache onto a file, so that the positions solved in earlier runs are used
+// and the positions solved from now on are written back to it. The file is created if
+// it doesn't exist, and is rebuilt if it was saved with a different cache size. This
+// should be called before the cache is used, since the entries are replaced.
+bool aiCacheLoad(const char *filename) {
+	if (endgameCache.entries == NULL || endgameCache.mapping.data != NULL) {
+		return false;
+	}
+
+	if (cacheMapFile(filename)) {
+		return true;
+	}
+
+	// Keep the positions in the old file, then replace it with a file of the right size.
+	cacheImportFile(filename);
+	if (!cacheWriteFile(filename) || !cacheMapFile(filename)) {
+		fprintf(stderr, "Unable to map the endgame cache to %s\n", filename);
+		return false;
+	}
+
+	return true;
+}
+
+// Saves the solved endgame positions in the cache to a file. If the cache is mapped
+// onto a file, the changes are written back to that file instead.
+bool aiCacheSave(const char *filename) {
+	if (endgameCache.entries == NULL) {
+		return false;
+	}
+
+	bool success = endgameCache.mapping.data != NULL ?
+		databaseFlushFile(&endgameCache.mapping) : cacheWriteFile(filename);
+	if (!success) {
+		fprintf(stderr, "Unable to save the endgame cache to %s\n", filename);
+	}
+
+	return success;
+}
+
+// Frees the cache of solved endgame positions from memory.
+void aiCacheFree() {
+	if (endgameCache.mapping.data != NULL) {
+		databaseUnmapFile(&endgameCache.mapping);
+	} else {
+		free(endgameCache.entries);
+	}
+
+	endgameCache.entries = NULL;
+	endgameCache.size = 0;
+}
+
+// Looks up the result of a position in the cache, returning false if it hasn't been
+// solved.
+bool cacheProbe(Bitboard player, Bitboard opponent, int *score, int *bound, int *move) {
+	if (endgameCache.entries == NULL) {
+		return false;
+	}
+
+	int index = (int)(bitboardHash(player, opponent) & (endgameCache.size - 1)) & ~1;
+	for (int i = index; i < index + 2; i++) {
+		CacheEntry *entry = &endgameCache.entries[i];
+		Bitboard data = entry->data.load(std::memory_order_relaxed);
+		if (data != 0 && (entry->player.load(std::memory_order_relaxed) ^ data) == player &&
+			(entry->opponent.load(std::memory_order_relaxed) ^ data) == opponent) {
+			*score = (signed char)(data >> 8);
+			*bound = (int)(data >> 16) & 0xFF;
+			*move = (signed char)(data >> 24);
+			return true;
 		}
+	}
+
+	return false;
+}
 
-		move = move->next;
+// Stores the result of a solved position in the cache. If the position's bucket is
+// full, then the entry with the fewest empty tiles is evicted since it is the cheapest
+// to solve again.
+void cacheStore(Bitboard player, Bitboard opponent, int empties, int score, int bound,
+				int move) {
+	if (endgameCache.entries == NULL) {
+		return;
 	}
 
-	freeMoveList(validMoves);
-	return best;
+	int index = (int)(bitboardHash(player, opponent) & (endgameCache.size - 1)) & ~1;
+	CacheEntry *replace = NULL;
+	int replaceEmpties = 0;
+	bool found = false;
+	for (int i = index; i < index + 2; i++) {
+		CacheEntry *entry = &endgameCache.entries[i];
+		Bitboard data = entry->data.load(std::memory_order_relaxed);
+		if (data != 0 && (entry->player.load(std::memory_order_relaxed) ^ data) == player &&
+			(entry->opponent.load(std::memory_order_relaxed) ^ data) == opponent) {
+			replace = entry;
+			found = true;
+			break;
+		}
+
+		if (replace == NULL || (int)(data & 0xFF) < replaceEmpties) {
+			replace = entry;
+			replaceEmpties = (int)(data & 0xFF);
+		}
+	}
+
+	// Another thread may be storing to the same entry, but since the data is written
+	// first, a reader only sees the new data once it matches the new position.
+	Bitboard data = cachePack(empties, score, bound, move);
+	Bitboard old = replace->data.exchange(data, std::memory_order_relaxed);
+	replace->player.store(player ^ data, std::memory_order_relaxed);
+	replace->opponent.store(opponent ^ data, std::memory_order_relaxed);
+
+	if (old == 0) {
+		endgameCache.used.fetch_add(1, std::memory_order_relaxed);
+	} else if (!found) {
+		endgameCache.evictions.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+// Packs the result of a solved position into the data of a cache entry. Positions in
+// the cache always have empty tiles, so the data is never zero.
+Bitboard cachePack(int empties, int score, int bound, int move) {
+	return (Bitboard)(unsigned char)empties | (Bitboard)(unsigned char)score << 8 |
+		(Bitboard)(unsigned char)bound << 16 | (Bitboard)(unsigned char)move << 24;
 }
 
-// Gets the value of the highest scoring move.
-int getHighestScoringMove(char board[BOARD_SIZE][BOARD_SIZE], int piece) {
-	Move *validMoves = getValidMoves(board, piece);
+// Maps the cache onto a file saved with the same cache size, returning false if there
+// is no such file.
+bool cacheMapFile(const char *filename) {
+	MappedFile mapped;
+	if (!databaseMapFile(filename, true, &mapped)) {
+		return false;
+	}
 
-	// Find the move which grants the highest score.
-	Move *best = NULL;
-	Move *move = validMoves;
-	while (move != NULL) {
-		if (best == NULL || move->score > best->score) {
-			best = move;
+	CacheFileHeader header;
+	if (!cacheReadHeader(&mapped, &header) || header.size != (unsigned int)endgameCache.size) {
+		databaseUnmapFile(&mapped);
+		return false;
+	}
+
+	free(endgameCache.entries);
+	endgameCache.entries = (CacheEntry*)(mapped.data + sizeof(CacheFileHeader));
+	endgameCache.mapping = mapped;
+
+	int used = 0;
+	for (int i = 0; i < endgameCache.size; i++) {
+		if (endgameCache.entries[i].data.load(std::memory_order_relaxed) != 0) {
+			used++;
 		}
+	}
+
+	endgameCache.used = used;
+	endgameCache.evictions = 0;
+	return true;
+}
 
-		move = move->next;
+// Stores the positions from a cache file saved with any cache size in the cache.
+void cacheImportFile(const char *filename) {
+	MappedFile mapped;
+	if (!databaseMapFile(filename, false, &mapped)) {
+		return;
 	}
 
-	int score = best != NULL ? best->score : 0;
-	freeMoveList(validMoves);
-	return score;
+	CacheFileHeader header;
+	if (!cacheReadHeader(&mapped, &header)) {
+		fprintf(stderr, "Ignoring invalid endgame cache file %s\n", filename);
+		databaseUnmapFile(&mapped);
+		return;
+	}
+
+	CacheEntry *entries = (CacheEntry*)(mapped.data + sizeof(CacheFileHeader));
+	for (unsigned int i = 0; i < header.size; i++) {
+		Bitboard data = entries[i].data.load(std::memory_order_relaxed);
+		if (data != 0) {
+			cacheStore(entries[i].player.load(std::memory_order_relaxed) ^ data,
+					   entries[i].opponent.load(std::memory_order_relaxed) ^ data,
+					   (int)(data & 0xFF), (signed char)(data >> 8), (int)(data >> 16) & 0xFF,
+					   (signed char)(data >> 24));
+		}
+	}
+
+	databaseUnmapFile(&mapped);
+}
+
+// Writes every entry of the cache to a file, in the form that cacheMapFile maps.
+bool cacheWriteFile(const char *filename) {
+	FILE *file = fopen(filename, "wb");
+	if (file == NULL) {
+		return false;
+	}
+
+	CacheFileHeader header = { CACHE_FILE_MAGIC, CACHE_FILE_VERSION,
+		(unsigned int)endgameCache.size, sizeof(CacheEntry) };
+	bool success = fwrite(&header, sizeof(header), 1, file) == 1 &&
+		fwrite(endgameCache.entries, sizeof(CacheEntry), endgameCache.size, file) ==
+			(size_t)endgameCache.size;
+
+	return fclose(file) == 0 && success;
+}
+
+// Reads the header of a mapped cache file, returning false if it isn't a valid file.
+bool cacheReadHeader(MappedFile *mapped, CacheFileHeader *header) {
+	if (mapped->length < sizeof(CacheFileHeader)) {
+		return false;
+	}
+
+	memcpy(header, mapped->data, sizeof(CacheFileHeader));
+	return header->magic == CACHE_FILE_MAGIC && header->version == CACHE_FILE_VERSION &&
+		header->entrySize == sizeof(CacheEntry) && header->size >= 2 &&
+		(header->size & (header->size - 1)) == 0 &&
+		mapped->length == sizeof(CacheFileHeader) + (size_t)header->size * sizeof(CacheEntry);
 }
 
 // Inserts a new move node into the linked list and returns the new head.
@@ -277,8 +1114,3 @@ void freeMoveList(Move *head) {
 		move = next;
 	}
 }
-
-// Gets the piece of the opposite color.
-int getOpponentPiece(int piece) {
-	return piece == PIECE_WHITE ? PIECE_BLACK : PIECE_WHITE;
-}
@@ -0,0 +1,320 @@
+#include "reversi.h"
+
+// Bitboards used to mask out tiles which would wrap around to the other side of the
+// board when shifting along the x-axis.
+#define BITBOARD_NOT_LEFT 0xFEFEFEFEFEFEFEFEULL
+#define BITBOARD_NOT_RIGHT 0x7F7F7F7F7F7F7F7FULL
+
+// The parts of each symmetry, which are applied in the order transpose, mirror x and
+// then mirror y.
+#define SYMMETRY_MIRROR_X 1
+#define SYMMETRY_MIRROR_Y 2
+#define SYMMETRY_TRANSPOSE 4
+
+// Function prototypes.
+Bitboard bitboardShift(Bitboard bits, int direction);
+Bitboard bitboardGetFullLines(Bitboard occupied, int direction);
+Bitboard bitboardMirrorX(Bitboard bits);
+Bitboard bitboardMirrorY(Bitboard bits);
+Bitboard bitboardTranspose(Bitboard bits);
+void bitboardGetSymmetries(Bitboard bits, Bitboard symmetries[BITBOARD_SYMMETRIES]);
+
+// Converts a board into a pair of bitboards, one holding the pieces of the given
+// player and the other holding the pieces of their opponent.
+void bitboardFromBoard(char board[BOARD_SIZE][BOARD_SIZE], int piece, Bitboard *player,
+					   Bitboard *opponent) {
+	*player = 0;
+	*opponent = 0;
+	for (int x = 0; x < BOARD_SIZE; x++) {
+		for (int y = 0; y < BOARD_SIZE; y++) {
+			if (board[x][y] == piece) {
+				*player |= BITBOARD_TILE(x, y);
+			} else if (board[x][y] != PIECE_EMPTY) {
+				*opponent |= BITBOARD_TILE(x, y);
+			}
+		}
+	}
+}
+
+// Gets a bitboard containing every tile that the player can move to.
+Bitboard bitboardGetMoves(Bitboard player, Bitboard opponent) {
+	Bitboard empty = ~(player | opponent);
+	Bitboard moves = 0;
+	for (int direction = 0; direction < 8; direction++) {
+		// Follow each run of the opponent's pieces starting next to one of the player's
+		// pieces. A run can be at most six tiles long.
+		Bitboard run = bitboardShift(player, direction) & opponent;
+		for (int i = 0; i < 5; i++) {
+			run |= bitboardShift(run, direction) & opponent;
+		}
+
+		moves |= bitboardShift(run, direction) & empty;
+	}
+
+	return moves;
+}
+
+// Gets a bitboard containing the pieces that would be turned over if the player were
+// to place a piece on the tile with the given index.
+Bitboard bitboardGetFlips(Bitboard player, Bitboard opponent, int index) {
+	Bitboard move = (Bitboard)1 << index;
+	Bitboard flips = 0;
+	for (int direction = 0; direction < 8; direction++) {
+		Bitboard line = 0;
+		Bitboard tile = bitboardShift(move, direction);
+		while (tile & opponent) {
+			line |= tile;
+			tile = bitboardShift(tile, direction);
+		}
+
+		// The run of pieces is only turned over if it is capped by the player's piece.
+		if (tile & player) {
+			flips |= line;
+		}
+	}
+
+	return flips;
+}
+
+// Counts the number of tiles set in a bitboard.
+int bitboardCount(Bitboard bits) {
+	bits = bits - ((bits >> 1) & 0x5555555555555555ULL);
+	bits = (bits & 0x3333333333333333ULL) + ((bits >> 2) & 0x3333333333333333ULL);
+	bits = (bits + (bits >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+	return (int)((bits * 0x0101010101010101ULL) >> 56);
+}
+
+// Gets the index of the lowest tile set in a non-empty bitboard.
+int bitboardFirstIndex(Bitboard bits) {
+	return bitboardCount((bits & (~bits + 1)) - 1);
+}
+
+// Gets a bitboard containing the player's pieces which can never be turned over. A
+// piece is stable if, along each of the four lines through it, either the line is
+// full or the piece is next to the edge of the board or another stable piece.
+Bitboard bitboardGetStable(Bitboard player, Bitboard opponent) {
+	Bitboard occupied = player | opponent;
+
+	// Find the tiles along each axis which are on full lines or next to the edge.
+	Bitboard full[4];
+	Bitboard edge[4];
+	for (int axis = 0; axis < 4; axis++) {
+		full[axis] = bitboardGetFullLines(occupied, axis * 2) &
+			bitboardGetFullLines(occupied, axis * 2 + 1);
+		edge[axis] = ~(bitboardShift(~(Bitboard)0, axis * 2) &
+			bitboardShift(~(Bitboard)0, axis * 2 + 1));
+	}
+
+	// Start with the pieces which are protected along every axis without help from
+	// any other piece (e.g. corners), then spread stability inwards from them until
+	// nothing more changes.
+	Bitboard stable = 0;
+	Bitboard previous;
+	do {
+		previous = stable;
+
+		Bitboard spread = player;
+		for (int axis = 0; axis < 4; axis++) {
+			spread &= full[axis] | edge[axis] | bitboardShift(stable, axis * 2) |
+				bitboardShift(stable, axis * 2 + 1);
+		}
+
+		stable |= spread;
+	} while (stable != previous);
+
+	return stable;
+}
+
+// Gets a 64-bit hash of a position from the point of view of the player to move.
+Bitboard bitboardHash(Bitboard player, Bitboard opponent) {
+	Bitboard hash = player * 0x9E3779B97F4A7C15ULL;
+	hash ^= (opponent + 0x632BE59BD9B4E019ULL) * 0xBF58476D1CE4E5B9ULL;
+	hash ^= hash >> 31;
+	hash *= 0x94D049BB133111EBULL;
+	hash ^= hash >> 29;
+	return hash;
+}
+
+// Applies one of the BITBOARD_SYMMETRIES symmetries of the board to a bitboard.
+// Symmetry zero leaves the bitboard unchanged.
+Bitboard bitboardTransform(Bitboard bits, int symmetry) {
+	if (symmetry & SYMMETRY_TRANSPOSE) {
+		bits = bitboardTranspose(bits);
+	}
+
+	if (symmetry & SYMMETRY_MIRROR_X) {
+		bits = bitboardMirrorX(bits);
+	}
+
+	if (symmetry & SYMMETRY_MIRROR_Y) {
+		bits = bitboardMirrorY(bits);
+	}
+
+	return bits;
+}
+
+// Undoes one of the symmetries of the board applied by bitboardTransform.
+Bitboard bitboardInverseTransform(Bitboard bits, int symmetry) {
+	if (symmetry & SYMMETRY_MIRROR_Y) {
+		bits = bitboardMirrorY(bits);
+	}
+
+	if (symmetry & SYMMETRY_MIRROR_X) {
+		bits = bitboardMirrorX(bits);
+	}
+
+	if (symmetry & SYMMETRY_TRANSPOSE) {
+		bits = bitboardTranspose(bits);
+	}
+
+	return bits;
+}
+
+// Gets the index of the tile that a tile is moved to by one of the symmetries of the
+// board. MOVE_PASS is left unchanged.
+int bitboardTransformIndex(int index, int symmetry) {
+	if (index < 0) {
+		return index;
+	}
+
+	return bitboardFirstIndex(bitboardTransform((Bitboard)1 << index, symmetry));
+}
+
+// Gets the index of the tile that is moved to the given tile by one of the symmetries
+// of the board. MOVE_PASS is left unchanged.
+int bitboardInverseTransformIndex(int index, int symmetry) {
+	if (index < 0) {
+		return index;
+	}
+
+	return bitboardFirstIndex(bitboardInverseTransform((Bitboard)1 << index, symmetry));
+}
+
+// Replaces a position with its canonical form, which is the same for every position
+// that is symmetric to it. Returns the symmetry that was applied to the position.
+int bitboardCanonicalise(Bitboard *player, Bitboard *opponent) {
+	Bitboard players[BITBOARD_SYMMETRIES];
+	Bitboard opponents[BITBOARD_SYMMETRIES];
+	bitboardGetSymmetries(*player, players);
+	bitboardGetSymmetries(*opponent, opponents);
+
+	// The canonical form is the one with the lowest pair of bitboards.
+	int best = 0;
+	for (int symmetry = 1; symmetry < BITBOARD_SYMMETRIES; symmetry++) {
+		if (players[symmetry] < players[best] ||
+			(players[symmetry] == players[best] && opponents[symmetry] < opponents[best])) {
+			best = symmetry;
+		}
+	}
+
+	*player = players[best];
+	*opponent = opponents[best];
+	return best;
+}
+
+// Gets a 64-bit hash of a position which is the same for every position that is
+// symmetric to it.
+Bitboard bitboardCanonicalHash(Bitboard player, Bitboard opponent) {
+	bitboardCanonicalise(&player, &opponent);
+	return bitboardHash(player, opponent);
+}
+
+// Gets a bitboard containing every tile that the player can move to, leaving out any
+// move which leads to the same position as another move up to symmetry.
+Bitboard bitboardGetUniqueMoves(Bitboard player, Bitboard opponent) {
+	Bitboard moves = bitboardGetMoves(player, opponent);
+	for (int symmetry = 1; symmetry < BITBOARD_SYMMETRIES; symmetry++) {
+		if (bitboardTransform(player, symmetry) != player ||
+			bitboardTransform(opponent, symmetry) != opponent) {
+			continue;
+		}
+
+		// The position is unchanged by the symmetry, so each move is equivalent to the
+		// move that the symmetry turns it into. Only the lowest tile of each set of
+		// equivalent moves is kept.
+		Bitboard remaining = moves;
+		while (remaining != 0) {
+			int index = bitboardFirstIndex(remaining);
+			remaining &= remaining - 1;
+			if (bitboardTransformIndex(index, symmetry) < index) {
+				moves &= ~((Bitboard)1 << index);
+			}
+		}
+	}
+
+	return moves;
+}
+
+// Shifts every tile of a bitboard by one step in one of the eight directions, dropping
+// any tiles that would leave the board.
+Bitboard bitboardShift(Bitboard bits, int direction) {
+	switch (direction) {
+		case 0: return (bits << 1) & BITBOARD_NOT_LEFT; // Right.
+		case 1: return (bits >> 1) & BITBOARD_NOT_RIGHT; // Left.
+		case 2: return bits << BOARD_SIZE; // Down.
+		case 3: return bits >> BOARD_SIZE; // Up.
+		case 4: return (bits << (BOARD_SIZE + 1)) & BITBOARD_NOT_LEFT; // Down and right.
+		case 5: return (bits >> (BOARD_SIZE + 1)) & BITBOARD_NOT_RIGHT; // Up and left.
+		case 6: return (bits << (BOARD_SIZE - 1)) & BITBOARD_NOT_RIGHT; // Down and left.
+		case 7: return (bits >> (BOARD_SIZE - 1)) & BITBOARD_NOT_LEFT; // Up and right.
+	}
+
+	return 0;
+}
+
+// Gets a bitboard containing the tiles from which every tile in the given direction up
+// to the edge of the board is occupied.
+Bitboard bitboardGetFullLines(Bitboard occupied, int direction) {
+	// Tiles next to the edge of the board are full in that direction if they are
+	// occupied. Every other tile is full if its neighbour in that direction is full.
+	int opposite = direction ^ 1;
+	Bitboard edge = ~bitboardShift(~(Bitboard)0, opposite);
+	Bitboard full = occupied & edge;
+	for (int i = 1; i < BOARD_SIZE; i++) {
+		full |= occupied & bitboardShift(full, opposite);
+	}
+
+	return full;
+}
+
+// Gets every symmetry of a bitboard, in the order used by bitboardTransform. Each
+// symmetry is built from an earlier one so that as few steps as possible are needed.
+void bitboardGetSymmetries(Bitboard bits, Bitboard symmetries[BITBOARD_SYMMETRIES]) {
+	symmetries[0] = bits;
+	symmetries[SYMMETRY_TRANSPOSE] = bitboardTranspose(bits);
+	for (int i = 0; i < BITBOARD_SYMMETRIES; i += SYMMETRY_TRANSPOSE) {
+		symmetries[i | SYMMETRY_MIRROR_X] = bitboardMirrorX(symmetries[i]);
+		symmetries[i | SYMMETRY_MIRROR_Y] = bitboardMirrorY(symmetries[i]);
+		symmetries[i | SYMMETRY_MIRROR_X | SYMMETRY_MIRROR_Y] =
+			bitboardMirrorY(symmetries[i | SYMMETRY_MIRROR_X]);
+	}
+}
+
+// Mirrors a bitboard from left to right.
+Bitboard bitboardMirrorX(Bitboard bits) {
+	bits = ((bits >> 1) & 0x5555555555555555ULL) | ((bits & 0x5555555555555555ULL) << 1);
+	bits = ((bits >> 2) & 0x3333333333333333ULL) | ((bits & 0x3333333333333333ULL) << 2);
+	bits = ((bits >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((bits & 0x0F0F0F0F0F0F0F0FULL) << 4);
+	return bits;
+}
+
+// Mirrors a bitboard from top to bottom.
+Bitboard bitboardMirrorY(Bitboard bits) {
+	bits = ((bits >> 8) & 0x00FF00FF00FF00FFULL) | ((bits & 0x00FF00FF00FF00FFULL) << 8);
+	bits = ((bits >> 16) & 0x0000FFFF0000FFFFULL) | ((bits & 0x0000FFFF0000FFFFULL) << 16);
+	bits = (bits >> 32) | (bits << 32);
+	return bits;
+}
+
+// Swaps the x and y coordinates of every tile of a bitboard.
+Bitboard bitboardTranspose(Bitboard bits) {
+	// Swap the 4x4 blocks off the diagonal, then the 2x2 blocks within each 4x4 block,
+	// then the tiles within each 2x2 block.
+	Bitboard swap = 0x0F0F0F0F00000000ULL & (bits ^ (bits << 28));
+	bits ^= swap ^ (swap >> 28);
+	swap = 0x3333000033330000ULL & (bits ^ (bits << 14));
+	bits ^= swap ^ (swap >> 14);
+	swap = 0x5500550055005500ULL & (bits ^ (bits << 7));
+	bits ^= swap ^ (swap >> 7);
+	return bits;
+}
@@ -0,0 +1,768 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "reversi.h"
+
+#define DATABASE_FILE_MAGIC 0x44475652 // "RVGD"
+#define DATABASE_INDEX_MAGIC 0x49475652 // "RVGI"
+#define DATABASE_FILE_VERSION 1
+#define DATABASE_INDEX_VERSION 3
+
+// The number of entries and postings that an index starts with. Both double in size
+// whenever they run out of room, and the entries are kept at most three quarters full.
+#define DATABASE_MIN_ENTRIES (1 << 16)
+#define DATABASE_MIN_POSTINGS (1 << 16)
+
+#define POSTING_NONE -1
+
+struct _PositionEntry {
+	// The canonical form of the position, from the point of view of the player to move.
+	// Both are zero if the entry is unused.
+	Bitboard player;
+	Bitboard opponent;
+
+	// The number of games which passed through the position, and how many of them were
+	// won and lost by the player to move.
+	int games;
+	int wins;
+	int losses;
+
+	// The posting of the most recent game which passed through the position.
+	int lastPosting;
+};
+
+// Stores the results of every game which passed through a position.
+typedef struct _PositionEntry PositionEntry;
+
+struct _Posting {
+	// The ID of the game.
+	int game;
+
+	// The posting of the previous game which passed through the same position.
+	int next;
+};
+
+// Stores one of the games which passed through a position.
+typedef struct _Posting Posting;
+
+struct _PositionIndex {
+	// An open addressing hash table of positions, where the size is always a power of
+	// two.
+	PositionEntry *entries;
+	int size;
+	int used;
+
+	// The lists of games which passed through each position.
+	Posting *postings;
+	int postingCount;
+	int postingSize;
+};
+
+// Stores the positions reached in a set of games.
+typedef struct _PositionIndex PositionIndex;
+
+struct _Database {
+	// The file containing the game records, and the number of records in it.
+	FILE *file;
+	int gameCount;
+
+	// The index saved by databaseSave, which is used straight from its mapped file and
+	// never changed, along with the number of games that it covers.
+	MappedFile mapping;
+	PositionIndex saved;
+	int savedGameCount;
+
+	// The index of the games added since, which is kept in memory until databaseSave
+	// merges it into the saved index.
+	PositionIndex added;
+};
+
+// Stores the game records along with an index of the positions reached in them.
+typedef struct _Database Database;
+
+struct _DatabaseFileHeader {
+	unsigned int magic;
+	unsigned int version;
+};
+
+// The header at the start of a file containing game records.
+typedef struct _DatabaseFileHeader DatabaseFileHeader;
+
+struct _DatabaseIndexHeader {
+	unsigned int magic;
+	unsigned int version;
+
+	// The number of games that had been indexed when the index was saved.
+	int gameCount;
+
+	// The sizes of the arrays which follow the header.
+	int size;
+	int used;
+	int postingCount;
+};
+
+// The header at the start of a file containing the index of a database.
+typedef struct _DatabaseIndexHeader DatabaseIndexHeader;
+
+// The games database shared by every game.
+Database database;
+
+// Function prototypes.
+int databaseMapIndex(const char *filename);
+bool databaseCheckIndex(PositionIndex *index, int gameCount);
+bool databaseIndexGame(int id, const GameRecord *game);
+bool databaseIndexPosition(Bitboard player, Bitboard opponent, int result, int id);
+bool databaseMergeIndex(PositionIndex *merged);
+bool databaseWriteIndex(const char *filename, PositionIndex *index, int gameCount);
+
+bool databaseInitIndex(PositionIndex *index, int size, int postingSize);
+void databaseFreeIndex(PositionIndex *index);
+PositionEntry *databaseFindEntry(PositionIndex *index, Bitboard player, Bitboard opponent);
+bool databaseGrowEntries(PositionIndex *index);
+
+// Opens a database of game records, creating the file if it doesn't exist. The index
+// is mapped from the second file, and any games added since it was saved are indexed.
+bool databaseOpen(const char *gamesFilename, const char *indexFilename) {
+	databaseClose();
+
+	database.file = fopen(gamesFilename, "r+b");
+	if (database.file == NULL) {
+		database.file = fopen(gamesFilename, "w+b");
+		DatabaseFileHeader header = { DATABASE_FILE_MAGIC, DATABASE_FILE_VERSION };
+		if (database.file == NULL || fwrite(&header, sizeof(header), 1, database.file) != 1) {
+			fprintf(stderr, "Unable to create the games database %s\n", gamesFilename);
+			databaseClose();
+			return false;
+		}
+	}
+
+	DatabaseFileHeader header;
+	rewind(database.file);
+	if (fread(&header, sizeof(header), 1, database.file) != 1 ||
+		header.magic != DATABASE_FILE_MAGIC || header.version != DATABASE_FILE_VERSION) {
+		fprintf(stderr, "Ignoring invalid games database %s\n", gamesFilename);
+		databaseClose();
+		return false;
+	}
+
+	// Any partly written record at the end of the file is ignored, and will be
+	// overwritten by the next game added.
+	fseek(database.file, 0, SEEK_END);
+	long length = ftell(database.file) - (long)sizeof(header);
+	database.gameCount = (int)(length / (long)sizeof(GameRecord));
+
+	// Start the index again if it was saved for a different file of games.
+	database.savedGameCount = databaseMapIndex(indexFilename);
+	if (database.savedGameCount < 0 || database.savedGameCount > database.gameCount) {
+		databaseUnmapFile(&database.mapping);
+		memset(&database.saved, 0, sizeof(database.saved));
+		database.savedGameCount = 0;
+	}
+
+	if (!databaseInitIndex(&database.added, DATABASE_MIN_ENTRIES, DATABASE_MIN_POSTINGS)) {
+		fprintf(stderr, "Unable to allocate the games database index\n");
+		databaseClose();
+		return false;
+	}
+
+	// Index the games which were added after the index was saved.
+	GameRecord game;
+	for (int id = database.savedGameCount; id < database.gameCount; id++) {
+		if (!databaseGetGame(id, &game) || !databaseIndexGame(id, &game)) {
+			fprintf(stderr, "Unable to index game %d of the games database\n", id);
+			databaseClose();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Saves the index of the database to a file, so that the games don't need to be
+// indexed again the next time the database is opened. Nothing is written if no games
+// have been indexed since the index was last saved.
+bool databaseSave(const char *filename) {
+	if (database.file == NULL) {
+		return false;
+	}
+
+	if (database.added.used == 0) {
+		return true;
+	}
+
+	PositionIndex merged;
+	if (!databaseMergeIndex(&merged)) {
+		fprintf(stderr, "Unable to allocate the games database index\n");
+		return false;
+	}
+
+	// The old index is still mapped, so write the new index next to it and only replace
+	// it once it has been unmapped.
+	char tempFilename[FILENAME_MAX];
+	snprintf(tempFilename, sizeof(tempFilename), "%s.tmp", filename);
+	if (!databaseWriteIndex(tempFilename, &merged, database.gameCount)) {
+		fprintf(stderr, "Unable to save the games database index to %s\n", filename);
+		remove(tempFilename);
+		databaseFreeIndex(&merged);
+		return false;
+	}
+
+	databaseUnmapFile(&database.mapping);
+	memset(&database.saved, 0, sizeof(database.saved));
+	database.savedGameCount = 0;
+	databaseFreeIndex(&database.added);
+
+	remove(filename);
+	if (rename(tempFilename, filename) != 0 || databaseMapIndex(filename) != database.gameCount) {
+		// Keep using the merged index from memory, so that no games are lost.
+		fprintf(stderr, "Unable to save the games database index to %s\n", filename);
+		databaseUnmapFile(&database.mapping);
+		memset(&database.saved, 0, sizeof(database.saved));
+		database.added = merged;
+		return false;
+	}
+
+	database.savedGameCount = database.gameCount;
+	databaseFreeIndex(&merged);
+	return databaseInitIndex(&database.added, DATABASE_MIN_ENTRIES, DATABASE_MIN_POSTINGS);
+}
+
+// Closes the database and frees its index from memory.
+void databaseClose() {
+	if (database.file != NULL) {
+		fclose(database.file);
+	}
+
+	databaseUnmapFile(&database.mapping);
+	databaseFreeIndex(&database.added);
+	memset(&database, 0, sizeof(database));
+}
+
+// Appends a finished game to the database and returns its ID, or -1 if it couldn't be
+// added.
+int databaseAddGame(const GameRecord *game) {
+	if (database.file == NULL) {
+		return -1;
+	}
+
+	int id = database.gameCount;
+	long offset = (long)sizeof(DatabaseFileHeader) + (long)id * (long)sizeof(GameRecord);
+	if (fseek(database.file, offset, SEEK_SET) != 0 ||
+		fwrite(game, sizeof(GameRecord), 1, database.file) != 1 ||
+		fflush(database.file) != 0) {
+		fprintf(stderr, "Unable to add a game to the games database\n");
+		return -1;
+	}
+
+	database.gameCount++;
+	if (!databaseIndexGame(id, game)) {
+		fprintf(stderr, "Unable to index game %d of the games database\n", id);
+	}
+
+	return id;
+}
+
+// Gets the number of games in the database.
+int databaseGetGameCount() {
+	return database.gameCount;
+}
+
+// Reads the game with the given ID from the database.
+bool databaseGetGame(int id, GameRecord *game) {
+	if (database.file == NULL || id < 0 || id >= database.gameCount) {
+		return false;
+	}
+
+	long offset = (long)sizeof(DatabaseFileHeader) + (long)id * (long)sizeof(GameRecord);
+	return fseek(database.file, offset, SEEK_SET) == 0 &&
+		fread(game, sizeof(GameRecord), 1, database.file) == 1;
+}
+
+// Gets the results of the games which passed through a position or any position
+// symmetric to it, from the point of view of the player with the given piece who is
+// to move. Returns false if no game passed through the position.
+bool databaseGetStats(char board[BOARD_SIZE][BOARD_SIZE], int piece, PositionStats *stats) {
+	Bitboard player, opponent;
+	bitboardFromBoard(board, piece, &player, &opponent);
+	bitboardCanonicalise(&player, &opponent);
+
+	stats->games = 0;
+	stats->wins = 0;
+	stats->losses = 0;
+
+	PositionIndex *indexes[2] = { &database.saved, &database.added };
+	for (int i = 0; i < 2; i++) {
+		PositionEntry *entry = databaseFindEntry(indexes[i], player, opponent);
+		if (entry != NULL && entry->games != 0) {
+			stats->games += entry->games;
+			stats->wins += entry->wins;
+			stats->losses += entry->losses;
+		}
+	}
+
+	stats->draws = stats->games - stats->wins - stats->losses;
+	return stats->games != 0;
+}
+
+// Gets the IDs of the games which passed through a position or any position symmetric
+// to it with the player with the given piece to move, starting with the most recent
+// game. At most the given number of IDs are output, and the number output is returned.
+int databaseGetGames(char board[BOARD_SIZE][BOARD_SIZE], int piece, int *ids, int maxIds) {
+	Bitboard player, opponent;
+	bitboardFromBoard(board, piece, &player, &opponent);
+	bitboardCanonicalise(&player, &opponent);
+
+	// The games indexed since the index was saved are the most recent.
+	int count = 0;
+	PositionIndex *indexes[2] = { &database.added, &database.saved };
+	for (int i = 0; i < 2; i++) {
+		PositionEntry *entry = databaseFindEntry(indexes[i], player, opponent);
+		if (entry == NULL || entry->games == 0) {
+			continue;
+		}
+
+		for (int j = entry->lastPosting; j != POSTING_NONE && count < maxIds;
+			 j = indexes[i]->postings[j].next) {
+			ids[count++] = indexes[i]->postings[j].game;
+		}
+	}
+
+	return count;
+}
+
+// Maps the index of the database from a file and returns the number of games which
+// had been indexed, or -1 if it couldn't be mapped.
+int databaseMapIndex(const char *filename) {
+	if (!databaseMapFile(filename, false, &database.mapping)) {
+		return -1;
+	}
+
+	DatabaseIndexHeader header;
+	size_t length = database.mapping.length;
+	if (length >= sizeof(header)) {
+		memcpy(&header, database.mapping.data, sizeof(header));
+	}
+
+	if (length < sizeof(header) ||
+		header.magic != DATABASE_INDEX_MAGIC || header.version != DATABASE_INDEX_VERSION ||
+		header.size < DATABASE_MIN_ENTRIES || (header.size & (header.size - 1)) != 0 ||
+		header.used < 0 || header.used >= header.size || header.postingCount < 0 ||
+		length < sizeof(header) + (size_t)header.size * sizeof(PositionEntry) +
+			(size_t)header.postingCount * sizeof(Posting)) {
+		fprintf(stderr, "Ignoring invalid games database index %s\n", filename);
+		databaseUnmapFile(&database.mapping);
+		return -1;
+	}
+
+	// The arrays are stored exactly as they are kept in memory, so they can be used
+	// straight from the file.
+	const char *data = database.mapping.data + sizeof(header);
+	database.saved.entries = (PositionEntry *)data;
+	database.saved.size = header.size;
+	database.saved.used = header.used;
+	database.saved.postings = (Posting *)(data + (size_t)header.size * sizeof(PositionEntry));
+	database.saved.postingCount = header.postingCount;
+	database.saved.postingSize = header.postingCount;
+
+	if (!databaseCheckIndex(&database.saved, header.gameCount)) {
+		fprintf(stderr, "Ignoring invalid games database index %s\n", filename);
+		databaseUnmapFile(&database.mapping);
+		memset(&database.saved, 0, sizeof(database.saved));
+		return -1;
+	}
+
+	return header.gameCount;
+}
+
+// Checks that every list of postings in an index mapped from a file stays within the
+// index and ends, so that a corrupt file can't be read out of bounds or forever.
+bool databaseCheckIndex(PositionIndex *index, int gameCount) {
+	if (gameCount < 0) {
+		return false;
+	}
+
+	// Each posting is added after the posting it links to, so a list which only ever
+	// links to earlier postings always ends.
+	for (int i = 0; i < index->postingCount; i++) {
+		Posting *posting = &index->postings[i];
+		if (posting->game < 0 || posting->game >= gameCount ||
+			(posting->next != POSTING_NONE && (posting->next < 0 || posting->next >= i))) {
+			return false;
+		}
+	}
+
+	// Finding an entry only ends once it reaches an unused entry, so there must be one.
+	int used = 0;
+	for (int i = 0; i < index->size; i++) {
+		PositionEntry *entry = &index->entries[i];
+		if (entry->games == 0) {
+			continue;
+		}
+
+		if (entry->lastPosting < 0 || entry->lastPosting >= index->postingCount) {
+			return false;
+		}
+
+		used++;
+	}
+
+	return used == index->used;
+}
+
+// Adds every position reached in a game to the index of games added since the index
+// was saved, by replaying the game from the start. The whole game is replayed before
+// any of it is indexed, so a game with an invalid move is skipped entirely. Returns
+// false if the index ran out of memory.
+bool databaseIndexGame(int id, const GameRecord *game) {
+	if (game->moveCount > GAME_MAX_MOVES) {
+		fprintf(stderr, "Game %d of the games database has too many moves\n", id);
+		return true;
+	}
+
+	char board[BOARD_SIZE][BOARD_SIZE];
+	boardReset(board);
+
+	// The first player is always white.
+	Bitboard players[GAME_MAX_MOVES + 1];
+	Bitboard opponents[GAME_MAX_MOVES + 1];
+	int results[GAME_MAX_MOVES + 1];
+	bitboardFromBoard(board, PIECE_WHITE, &players[0], &opponents[0]);
+	results[0] = game->score;
+
+	for (int i = 0; i < game->moveCount; i++) {
+		Bitboard player = players[i];
+		Bitboard opponent = opponents[i];
+		int result = results[i];
+
+		// The player passes if they can't move.
+		Bitboard moves = bitboardGetMoves(player, opponent);
+		if (moves == 0) {
+			Bitboard temp = player;
+			player = opponent;
+			opponent = temp;
+			result = -result;
+			moves = bitboardGetMoves(player, opponent);
+		}
+
+		int index = game->moves[i];
+		if (index >= SCORE_MAX || (moves & ((Bitboard)1 << index)) == 0) {
+			fprintf(stderr, "Game %d of the games database has an invalid move\n", id);
+			return true;
+		}
+
+		// Record the position as seen by the player who moved from it.
+		players[i] = player;
+		opponents[i] = opponent;
+		results[i] = result;
+
+		Bitboard flips = bitboardGetFlips(player, opponent, index);
+		players[i + 1] = opponent & ~flips;
+		opponents[i + 1] = player | flips | ((Bitboard)1 << index);
+		results[i + 1] = -result;
+	}
+
+	// The final position is also indexed, as seen by the player who would move next.
+	for (int i = 0; i <= game->moveCount; i++) {
+		if (!databaseIndexPosition(players[i], opponents[i], results[i], id)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Adds a game with the given result for the player to move to the entry for a position
+// in the index of games added since the index was saved.
+bool databaseIndexPosition(Bitboard player, Bitboard opponent, int result, int id) {
+	PositionIndex *index = &database.added;
+	if (index->postingCount == index->postingSize) {
+		Posting *postings = (Posting *)realloc(index->postings,
+											   index->postingSize * 2 * sizeof(Posting));
+		if (postings == NULL) {
+			return false;
+		}
+
+		index->postings = postings;
+		index->postingSize *= 2;
+	}
+
+	if ((index->used + 1) * 4 > index->size * 3 && !databaseGrowEntries(index)) {
+		return false;
+	}
+
+	// Symmetric positions are stored in the same entry.
+	bitboardCanonicalise(&player, &opponent);
+	PositionEntry *entry = databaseFindEntry(index, player, opponent);
+	if (entry->games == 0) {
+		entry->player = player;
+		entry->opponent = opponent;
+		entry->lastPosting = POSTING_NONE;
+		index->used++;
+	}
+
+	entry->games++;
+	if (result > 0) {
+		entry->wins++;
+	} else if (result < 0) {
+		entry->losses++;
+	}
+
+	Posting *posting = &index->postings[index->postingCount];
+	posting->game = id;
+	posting->next = entry->lastPosting;
+	entry->lastPosting = index->postingCount++;
+	return true;
+}
+
+// Combines the saved index with the index of the games added since into a new index.
+// The added postings follow the saved postings, and each list of added postings
+// continues into the saved list for the same position, which holds older games.
+bool databaseMergeIndex(PositionIndex *merged) {
+	PositionIndex *saved = &database.saved;
+	PositionIndex *added = &database.added;
+
+	int size = DATABASE_MIN_ENTRIES;
+	while ((saved->used + added->used) * 4 > size * 3) {
+		size *= 2;
+	}
+
+	int postingCount = saved->postingCount + added->postingCount;
+	if (!databaseInitIndex(merged, size, postingCount)) {
+		databaseFreeIndex(merged);
+		return false;
+	}
+
+	for (int i = 0; i < saved->size; i++) {
+		if (saved->entries[i].games != 0) {
+			PositionEntry *entry = &saved->entries[i];
+			*databaseFindEntry(merged, entry->player, entry->opponent) = *entry;
+			merged->used++;
+		}
+	}
+
+	int offset = saved->postingCount;
+	if (saved->postingCount > 0) {
+		memcpy(merged->postings, saved->postings, saved->postingCount * sizeof(Posting));
+	}
+
+	for (int i = 0; i < added->postingCount; i++) {
+		merged->postings[offset + i].game = added->postings[i].game;
+		merged->postings[offset + i].next = added->postings[i].next != POSTING_NONE ?
+			added->postings[i].next + offset : POSTING_NONE;
+	}
+
+	merged->postingCount = postingCount;
+
+	for (int i = 0; i < added->size; i++) {
+		PositionEntry *entry = &added->entries[i];
+		if (entry->games == 0) {
+			continue;
+		}
+
+		PositionEntry *target = databaseFindEntry(merged, entry->player, entry->opponent);
+		if (target->games == 0) {
+			target->player = entry->player;
+			target->opponent = entry->opponent;
+			target->lastPosting = POSTING_NONE;
+			merged->used++;
+		}
+
+		target->games += entry->games;
+		target->wins += entry->wins;
+		target->losses += entry->losses;
+
+		int last = entry->lastPosting + offset;
+		while (merged->postings[last].next != POSTING_NONE) {
+			last = merged->postings[last].next;
+		}
+
+		merged->postings[last].next = target->lastPosting;
+		target->lastPosting = entry->lastPosting + offset;
+	}
+
+	return true;
+}
+
+// Writes an index to a file, along with the number of games that it covers.
+bool databaseWriteIndex(const char *filename, PositionIndex *index, int gameCount) {
+	FILE *file = fopen(filename, "wb");
+	if (file == NULL) {
+		return false;
+	}
+
+	DatabaseIndexHeader header = { DATABASE_INDEX_MAGIC, DATABASE_INDEX_VERSION, gameCount,
+		index->size, index->used, index->postingCount };
+	bool success = fwrite(&header, sizeof(header), 1, file) == 1 &&
+		fwrite(index->entries, sizeof(PositionEntry), index->size, file) ==
+			(size_t)index->size &&
+		fwrite(index->postings, sizeof(Posting), index->postingCount, file) ==
+			(size_t)index->postingCount;
+
+	return fclose(file) == 0 && success;
+}
+
+// Allocates an empty index with room for the given number of entries and postings.
+bool databaseInitIndex(PositionIndex *index, int size, int postingSize) {
+	if (postingSize < DATABASE_MIN_POSTINGS) {
+		postingSize = DATABASE_MIN_POSTINGS;
+	}
+
+	index->entries = (PositionEntry *)calloc(size, sizeof(PositionEntry));
+	index->postings = (Posting *)malloc(postingSize * sizeof(Posting));
+	index->size = index->entries != NULL ? size : 0;
+	index->used = 0;
+	index->postingCount = 0;
+	index->postingSize = index->postings != NULL ? postingSize : 0;
+	return index->entries != NULL && index->postings != NULL;
+}
+
+// Frees an index allocated by databaseInitIndex from memory.
+void databaseFreeIndex(PositionIndex *index) {
+	free(index->entries);
+	free(index->postings);
+	memset(index, 0, sizeof(PositionIndex));
+}
+
+// Finds the entry for a canonical position, or the unused entry where it would be added.
+// Returns NULL if the index is empty.
+PositionEntry *databaseFindEntry(PositionIndex *index, Bitboard player, Bitboard opponent) {
+	if (index->entries == NULL) {
+		return NULL;
+	}
+
+	// Use linear probing, starting from a slot chosen by the upper bits of the hash.
+	int mask = index->size - 1;
+	int i = (int)(bitboardHash(player, opponent) >> 32) & mask;
+	while (index->entries[i].games != 0 &&
+		   (index->entries[i].player != player || index->entries[i].opponent != opponent)) {
+		i = (i + 1) & mask;
+	}
+
+	return &index->entries[i];
+}
+
+// Doubles the number of entries in an index, moving each used entry into its new slot.
+bool databaseGrowEntries(PositionIndex *index) {
+	PositionEntry *entries = index->entries;
+	int size = index->size;
+
+	index->entries = (PositionEntry *)calloc(size * 2, sizeof(PositionEntry));
+	if (index->entries == NULL) {
+		index->entries = entries;
+		return false;
+	}
+
+	index->size = size * 2;
+	for (int i = 0; i < size; i++) {
+		if (entries[i].games != 0) {
+			*databaseFindEntry(index, entries[i].player, entries[i].opponent) = entries[i];
+		}
+	}
+
+	free(entries);
+	return true;
+}
+
+// Maps a file into memory so that it doesn't need to be copied. If the file is mapped
+// as writable, changes to the memory are written back to the file.
+bool databaseMapFile(const char *filename, bool writable, MappedFile *mapped) {
+	memset(mapped, 0, sizeof(MappedFile));
+
+#ifdef _WIN32
+	DWORD access = writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ;
+	HANDLE file = CreateFileA(filename, access, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+							  FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER length;
+	HANDLE mapping = NULL;
+	void *data = NULL;
+	if (GetFileSizeEx(file, &length) && length.QuadPart > 0) {
+		mapping = CreateFileMappingA(file, NULL, writable ? PAGE_READWRITE : PAGE_READONLY, 0, 0,
+									 NULL);
+	}
+
+	if (mapping != NULL) {
+		data = MapViewOfFile(mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0);
+	}
+
+	if (data == NULL) {
+		if (mapping != NULL) {
+			CloseHandle(mapping);
+		}
+
+		CloseHandle(file);
+		return false;
+	}
+
+	mapped->data = (char *)data;
+	mapped->length = (size_t)length.QuadPart;
+	mapped->file = file;
+	mapped->mapping = mapping;
+#else
+	int file = open(filename, writable ? O_RDWR : O_RDONLY);
+	if (file < 0) {
+		return false;
+	}
+
+	// The mapping stays valid once the file is closed.
+	struct stat info;
+	void *data = MAP_FAILED;
+	if (fstat(file, &info) == 0 && info.st_size > 0) {
+		data = mmap(NULL, (size_t)info.st_size, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+					MAP_SHARED, file, 0);
+	}
+
+	close(file);
+	if (data == MAP_FAILED) {
+		return false;
+	}
+
+	mapped->data = (char *)data;
+	mapped->length = (size_t)info.st_size;
+#endif
+
+	return true;
+}
+
+// Writes any changes made to a file mapped as writable back to the disk.
+bool databaseFlushFile(MappedFile *mapped) {
+	if (mapped->data == NULL) {
+		return false;
+	}
+
+#ifdef _WIN32
+	return FlushViewOfFile(mapped->data, 0) != 0;
+#else
+	return msync(mapped->data, mapped->length, MS_SYNC) == 0;
+#endif
+}
+
+// Unmaps a file mapped by databaseMapFile. Does nothing if no file is mapped.
+void databaseUnmapFile(MappedFile *mapped) {
+	if (mapped->data == NULL) {
+		return;
+	}
+
+#ifdef _WIN32
+	UnmapViewOfFile(mapped->data);
+	CloseHandle((HANDLE)mapped->mapping);
+	CloseHandle((HANDLE)mapped->file);
+#else
+	munmap(mapped->data, mapped->length);
+#endif
+
+	memset(mapped, 0, sizeof(MappedFile));
+}
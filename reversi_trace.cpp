@@ -0,0 +1,224 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <new>
+#include <thread>
+
+#include "reversi.h"
+
+// The maximum number of threads which can record trace events.
+#define TRACE_MAX_THREADS 16
+
+// The number of events kept for each thread.
+#define TRACE_BUFFER_SIZE 65536
+
+#define TRACE_BEGIN 'B'
+#define TRACE_END 'E'
+#define TRACE_COUNTER 'C'
+
+struct _TraceEvent {
+	// The name of the event. This must point to a string which is never freed.
+	const char *name;
+
+	// The type of the event, as used by the Chrome trace event format.
+	char phase;
+
+	// The time of the event in microseconds since tracing started.
+	long long timestamp;
+
+	// The value of a counter event.
+	long long value;
+};
+
+// Stores a single trace event.
+typedef struct _TraceEvent TraceEvent;
+
+struct _TraceBuffer {
+	// The events recorded by the thread. Once the buffer is full, the oldest events
+	// are overwritten.
+	TraceEvent events[TRACE_BUFFER_SIZE];
+
+	// The total number of events that have been recorded. Only the thread which owns
+	// the buffer changes it, and it's published with release ordering once an event
+	// has been written.
+	std::atomic<long long> count;
+
+	// The count when tracing was last enabled, so that older events are left out.
+	long long start;
+
+	// Set by the owning thread while it might be writing an event, so that tracing can
+	// be stopped without reading events that are still being written.
+	std::atomic<bool> recording;
+
+	// The ID used to identify the thread in the trace.
+	int thread;
+};
+
+// Stores the trace events recorded by a single thread.
+typedef struct _TraceBuffer TraceBuffer;
+
+// Function prototypes.
+void traceRecord(const char *name, char phase, long long value);
+TraceBuffer *traceGetBuffer();
+
+// Indicates if trace events should be recorded.
+std::atomic<bool> traceEnabled(false);
+
+// The time that tracing started, which trace event timestamps are relative to.
+std::chrono::steady_clock::time_point traceStart = std::chrono::steady_clock::now();
+
+// The buffers of every thread which has recorded a trace event.
+TraceBuffer *traceBuffers[TRACE_MAX_THREADS];
+int traceBufferCount = 0;
+std::mutex traceBufferMutex;
+
+// The buffer of the current thread.
+thread_local TraceBuffer *traceThreadBuffer = NULL;
+
+// Enables or disables recording trace events. Enabling tracing discards any events
+// that were previously recorded. Disabling tracing waits until no other thread is in
+// the middle of recording an event.
+void traceSetEnabled(bool enabled) {
+	std::lock_guard<std::mutex> lock(traceBufferMutex);
+	if (enabled == traceEnabled.load()) {
+		return;
+	}
+
+	if (enabled) {
+		// No thread records events while tracing is disabled, so the start of each
+		// buffer and the start time can be changed safely before enabling it.
+		for (int i = 0; i < traceBufferCount; i++) {
+			traceBuffers[i]->start = traceBuffers[i]->count.load(std::memory_order_acquire);
+		}
+
+		traceStart = std::chrono::steady_clock::now();
+		traceEnabled.store(true);
+	} else {
+		// A thread which set its recording flag before this store will be waited for,
+		// and a thread which sets it afterwards will see that tracing is disabled.
+		traceEnabled.store(false);
+		for (int i = 0; i < traceBufferCount; i++) {
+			while (traceBuffers[i]->recording.load()) {
+				std::this_thread::yield();
+			}
+		}
+	}
+}
+
+// Checks if trace events are being recorded.
+bool traceIsEnabled() {
+	return traceEnabled.load(std::memory_order_relaxed);
+}
+
+// Records the start of a span of time with the given name on the current thread.
+void traceBegin(const char *name) {
+	if (traceEnabled.load(std::memory_order_relaxed)) {
+		traceRecord(name, TRACE_BEGIN, 0);
+	}
+}
+
+// Records the end of the span of time most recently started on the current thread.
+void traceEnd(const char *name) {
+	if (traceEnabled.load(std::memory_order_relaxed)) {
+		traceRecord(name, TRACE_END, 0);
+	}
+}
+
+// Records the current value of a counter with the given name.
+void traceCounter(const char *name, long long value) {
+	if (traceEnabled.load(std::memory_order_relaxed)) {
+		traceRecord(name, TRACE_COUNTER, value);
+	}
+}
+
+// Saves the recorded trace events to a file in the Chrome trace event format, which
+// can be opened in chrome://tracing or Perfetto. Tracing is disabled first if it's
+// still enabled, so that no other thread is writing to its buffer.
+bool traceSave(const char *filename) {
+	traceSetEnabled(false);
+
+	FILE *file = fopen(filename, "w");
+	if (file == NULL) {
+		fprintf(stderr, "Unable to save the trace to %s\n", filename);
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(traceBufferMutex);
+	fprintf(file, "{\"traceEvents\":[\n");
+
+	bool first = true;
+	for (int i = 0; i < traceBufferCount; i++) {
+		TraceBuffer *buffer = traceBuffers[i];
+
+		// Write the events in the order they were recorded, starting with the oldest
+		// event which hasn't been overwritten.
+		long long count = buffer->count.load(std::memory_order_acquire);
+		long long start = count - buffer->start > TRACE_BUFFER_SIZE ?
+			count - TRACE_BUFFER_SIZE : buffer->start;
+		for (long long j = start; j < count; j++) {
+			TraceEvent *event = &buffer->events[j % TRACE_BUFFER_SIZE];
+			fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%lld,\"pid\":1,\"tid\":%d",
+					first ? "" : ",\n", event->name, event->phase, event->timestamp, buffer->thread);
+			if (event->phase == TRACE_COUNTER) {
+				fprintf(file, ",\"args\":{\"value\":%lld}", event->value);
+			}
+
+			fprintf(file, "}");
+			first = false;
+		}
+	}
+
+	fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+	fclose(file);
+	return true;
+}
+
+// Records a trace event in the current thread's buffer.
+void traceRecord(const char *name, char phase, long long value) {
+	TraceBuffer *buffer = traceGetBuffer();
+	if (buffer == NULL) {
+		return;
+	}
+
+	// Check that tracing is still enabled after setting the recording flag, since it
+	// may have been disabled by another thread in the meantime.
+	buffer->recording.store(true);
+	if (traceEnabled.load()) {
+		long long count = buffer->count.load(std::memory_order_relaxed);
+		TraceEvent *event = &buffer->events[count % TRACE_BUFFER_SIZE];
+		event->name = name;
+		event->phase = phase;
+		event->timestamp = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - traceStart).count();
+		event->value = value;
+		buffer->count.store(count + 1, std::memory_order_release);
+	}
+
+	buffer->recording.store(false, std::memory_order_release);
+}
+
+// Gets the current thread's buffer, allocating it the first time that the thread
+// records an event. Returns NULL if there are too many threads to record any more.
+TraceBuffer *traceGetBuffer() {
+	if (traceThreadBuffer == NULL) {
+		std::lock_guard<std::mutex> lock(traceBufferMutex);
+		if (traceBufferCount >= TRACE_MAX_THREADS) {
+			return NULL;
+		}
+
+		// The buffer is value-initialised so that its atomic members are constructed
+		// and start at zero.
+		traceThreadBuffer = new (std::nothrow) TraceBuffer();
+		if (traceThreadBuffer == NULL) {
+			return NULL;
+		}
+
+		traceThreadBuffer->thread = traceBufferCount + 1;
+		traceBuffers[traceBufferCount++] = traceThreadBuffer;
+	}
+
+	return traceThreadBuffer;
+}